@@ -7,9 +7,12 @@
 #ifndef BUSTACHE_ADAPTED_BOOST_DESCRIBE_HPP_INCLUDED
 #define BUSTACHE_ADAPTED_BOOST_DESCRIBE_HPP_INCLUDED
 
-#include <bustache/model.hpp>
+#include <bustache/bind.hpp>
 #include <boost/describe/bases.hpp>
 #include <boost/describe/members.hpp>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
 
 namespace bustache::detail
 {
@@ -21,23 +24,180 @@ namespace bustache::detail
     using pub_bases =
         boost::describe::describe_bases<T, boost::describe::mod_public>;
 
+    template<class T>
+    using member_getter = value_ptr(*)(T const& self);
+
+    template<class T, class D>
+    value_ptr get_member(T const& self)
+    {
+        return &(self.*D::pointer);
+    }
+
+    template<template<class...> class L, class... D>
+    constexpr std::array<std::string_view, sizeof...(D)> member_names(L<D...>)
+    {
+        return {D::name...};
+    }
+
     template<class T, template<class...> class L, class... D>
-    bool visit_members(L<D...>, T const& self, std::string const& key, value_handler visit)
+    constexpr std::array<member_getter<T>, sizeof...(D)> member_getters(L<D...>)
     {
-        return (... || (key == D::name && (visit(&(self.*D::pointer)), true)));
+        return {get_member<T, D>...};
     }
 
-    template<class T>
-    bool visit_udt(T const& self, std::string const& key, value_handler visit)
+    template<class X, std::size_t... N>
+    constexpr std::array<X, (0 + ... + N)> concat(std::array<X, N> const&... a)
     {
-        return visit_members(pub_members<T>{}, self, key, visit);
+        std::array<X, (0 + ... + N)> ret{};
+        std::size_t i = 0;
+        auto const append = [&](auto const& a)
+        {
+            for (auto const& x : a)
+                ret[i++] = x;
+        };
+        (..., append(a));
+        return ret;
     }
 
+    // The slots are the public members of `T` in order, followed by those
+    // of its public bases.
+    template<class T, template<class...> class L, class... B>
+    constexpr auto slot_names(L<B...>)
+    {
+        return concat(member_names(pub_members<T>{}), member_names(pub_members<typename B::type>{})...);
+    }
+
+    template<class T, template<class...> class L, class... B>
+    constexpr auto slot_getters(L<B...>)
+    {
+        return concat(member_getters<T>(pub_members<T>{}), member_getters<T>(pub_members<typename B::type>{})...);
+    }
+
+    template<class T, class D>
+    using member_type = std::remove_cvref_t<decltype(std::declval<T const&>().*D::pointer)>;
+
     template<class T, template<class...> class L, class... D>
-    bool visit_bases(L<D...>, T const& self, std::string const& key, value_handler visit)
+    constexpr std::array<static_type const* (*)(), sizeof...(D)> member_types(L<D...>)
     {
-        return (... || visit_udt<typename D::type>(self, key, visit));
+        return {static_type_of<member_type<T, D>>...};
     }
+
+    template<class T, template<class...> class L, class... B>
+    constexpr auto slot_types(L<B...>)
+    {
+        return concat(member_types<T>(pub_members<T>{}), member_types<T>(pub_members<typename B::type>{})...);
+    }
+
+    constexpr std::uint64_t mix_hash(std::uint64_t h) noexcept
+    {
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+        return h ^ (h >> 31);
+    }
+
+    constexpr std::size_t ceil_pow2(std::size_t n) noexcept
+    {
+        std::size_t m = 1;
+        while (m < n)
+            m <<= 1;
+        return m;
+    }
+
+    // A perfect hash from the names to the slots, built at compile time by
+    // hash and displace over `ast::hash_key`, so a lookup takes the hash
+    // precomputed in `hashed_key` and does one comparison. The names hidden
+    // by the same ones before them, i.e. in the derived class, are left out.
+    template<std::size_t N>
+    struct slot_table
+    {
+        static constexpr std::size_t buckets = ceil_pow2(N / 4 + 1);
+        static constexpr std::size_t size = ceil_pow2(N + N / 2 + 1);
+
+        std::array<std::string_view, N> names;
+        std::array<std::uint32_t, buckets> disp{};
+        std::array<std::uint16_t, size> index{}; // The slot + 1, or 0.
+
+        static constexpr std::size_t bucket_of(std::size_t h) noexcept
+        {
+            return mix_hash(h) & (buckets - 1);
+        }
+
+        static constexpr std::size_t pos_of(std::size_t h, std::uint32_t d) noexcept
+        {
+            return mix_hash(h + (d + 1) * 0x9e3779b97f4a7c15) & (size - 1);
+        }
+
+        constexpr explicit slot_table(std::array<std::string_view, N> const& names) : names(names)
+        {
+            static_assert(N < 0xffff, "too many members");
+            std::array<std::size_t, N> hashes{};
+            std::array<bool, N> hidden{};
+            std::array<std::size_t, buckets> counts{};
+            for (std::size_t i = 0; i != N; ++i)
+            {
+                hashes[i] = ast::hash_key(names[i]);
+                for (std::size_t j = 0; j != i; ++j)
+                    hidden[i] = hidden[i] || names[j] == names[i];
+                if (!hidden[i])
+                    ++counts[bucket_of(hashes[i])];
+            }
+            // Place the largest buckets first.
+            std::array<std::size_t, N> taken{};
+            for (std::size_t n = N; n; --n)
+            {
+                for (std::size_t b = 0; b != buckets; ++b)
+                {
+                    if (counts[b] != n)
+                        continue;
+                    for (std::uint32_t d = 0;; ++d)
+                    {
+                        if (d == 0x100000)
+                            throw std::logic_error("bustache: no perfect hash for the member names");
+                        std::size_t k = 0;
+                        for (std::size_t i = 0; i != N; ++i)
+                        {
+                            if (hidden[i] || bucket_of(hashes[i]) != b)
+                                continue;
+                            auto const p = pos_of(hashes[i], d);
+                            bool free = !index[p];
+                            for (std::size_t j = 0; j != k; ++j)
+                                free = free && taken[j] != p;
+                            if (!free)
+                                break;
+                            taken[k++] = p;
+                        }
+                        if (k != n)
+                            continue;
+                        k = 0;
+                        for (std::size_t i = 0; i != N; ++i)
+                        {
+                            if (!hidden[i] && bucket_of(hashes[i]) == b)
+                                index[taken[k++]] = std::uint16_t(i + 1);
+                        }
+                        disp[b] = d;
+                        break;
+                    }
+                }
+            }
+        }
+
+        constexpr int find(hashed_key const& key) const noexcept
+        {
+            auto const i = index[pos_of(key.hash, disp[bucket_of(key.hash)])];
+            if (i && names[i - 1] == key.str)
+                return i - 1;
+            return -1;
+        }
+    };
+
+    template<class T>
+    inline constexpr auto slot_getters_of = slot_getters<T>(pub_bases<T>{});
+
+    template<class T>
+    inline constexpr auto slot_types_of = slot_types<T>(pub_bases<T>{});
+
+    template<class T>
+    inline constexpr slot_table<slot_getters_of<T>.size()> slot_table_of{slot_names<T>(pub_bases<T>{})};
 }
 
 namespace bustache
@@ -49,21 +209,27 @@ namespace bustache
     };
 
     template<DescribedUDT T>
-    struct bustache::impl_model<T>
+    struct impl_model<T>
     {
         static constexpr model kind = model::object;
     };
 
     template<DescribedUDT T>
-    struct bustache::impl_object<T>
+    struct impl_object<T>
     {
-        static void get(T const& self, std::string const& key, value_handler visit)
+        static int slot(hashed_key const& key)
+        {
+            return detail::slot_table_of<T>.find(key);
+        }
+
+        static value_ptr at(T const& self, int slot)
+        {
+            return detail::slot_getters_of<T>[slot](self);
+        }
+
+        static detail::static_type const* slot_type(int slot)
         {
-            if (detail::visit_udt(self, key, visit))
-                return;
-            if (detail::visit_bases(detail::pub_bases<T>{}, self, key, visit))
-                return;
-            return visit(nullptr);
+            return detail::slot_types_of<T>[slot]();
         }
     };
 }
@@ -51,10 +51,10 @@ namespace bustache
     template<>
     struct bustache::impl_object<boost::json::object>
     {
-        static void get(boost::json::object const& self, std::string const& key, value_handler visit)
+        static value_ptr find(boost::json::object const& self, std::string_view key)
         {
             auto const it = self.find(key);
-            visit(it == self.end() ? nullptr : &it->value());
+            return it == self.end() ? nullptr : &it->value();
         }
     };
 }
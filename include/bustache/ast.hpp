@@ -8,9 +8,32 @@
 #define BUSTACHE_AST_HPP_INCLUDED
 
 #include <unordered_map>
+#include <functional>
 #include <vector>
 #include <string>
 #include <string_view>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <span>
+
+#if defined(_WIN32)
+#   ifdef BUSTACHE_EXPORT
+#       define BUSTACHE_API __declspec(dllexport)
+#   elif defined(BUSTACHE_SHARED)
+#       define BUSTACHE_API __declspec(dllimport)
+#   endif
+#endif
+#ifndef BUSTACHE_API
+#   define BUSTACHE_API
+#endif
+
+namespace bustache
+{
+    struct format;
+}
 
 namespace bustache::ast
 {
@@ -42,16 +65,72 @@ namespace bustache::ast
 
     using override_map = std::unordered_map<std::string, content_list>;
 
+    // The hash of the keys (FNV-1a), `constexpr` so the models can build
+    // their tables at compile time.
+    constexpr std::size_t hash_key(std::string_view str) noexcept
+    {
+        if constexpr (sizeof(std::size_t) == 8)
+        {
+            std::size_t h = 0xcbf29ce484222325;
+            for (char c : str)
+                h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+            return h;
+        }
+        else
+        {
+            std::size_t h = 0x811c9dc5;
+            for (char c : str)
+                h = (h ^ static_cast<unsigned char>(c)) * 0x01000193;
+            return h;
+        }
+    }
+
+    // A segment of a dotted key, with its hash precomputed by `hash_key`.
+    struct segment
+    {
+        std::string str;
+        std::size_t hash = 0;
+
+        segment() = default;
+
+        explicit segment(std::string_view str)
+          : str(str), hash(hash_key(str))
+        {}
+    };
+
+    // The format spec after `:` in `{{var:spec}}`, parsed when the format is
+    // built, in the standard syntax:
+    //   [[fill]align][sign][#][0][width][.precision][L][type]
+    // where `type` is a letter or `?`, or a chrono spec (`type` is `%`).
+    // The other specs, e.g. those of a custom `impl_print`, aren't parsed
+    // and are passed to `print` as is.
+    // The spec parsed by fmt/std::format, see `detail::parse_spec`.
+    struct format_spec;
+
     struct variable
     {
         std::string key;
-        unsigned split;
+        unsigned split = 0;
+        // If `split` is non-zero and the spec is taken by the arithmetic types.
+        std::shared_ptr<format_spec const> spec = {};
+        // The segments of the key in `context::keys`, set by `context::add`.
+        unsigned path = 0;
+        unsigned path_size = 0;
     };
 
     struct block
     {
         std::string key;
         content_list contents;
+        // The segments of the key in `context::keys`, set by `context::add`.
+        unsigned path = 0;
+        unsigned path_size = 0;
+    };
+
+    // Where a partial is resolved ahead, see `template_set`.
+    struct partial_slot
+    {
+        format const* fmt = nullptr;
     };
 
     struct partial
@@ -59,6 +138,8 @@ namespace bustache::ast
         std::string key;
         std::string indent;
         override_map overriders;
+        // If non-null, used instead of looking up the context.
+        partial_slot const* slot = nullptr;
     };
 
     struct context
@@ -67,16 +148,56 @@ namespace bustache::ast
         std::vector<variable> variables;
         std::vector<block> blocks;
         std::vector<partial> partials;
+        // The keys of the variables and blocks, split by `.`.
+        // A leading `.` (i.e. the current context) is not a segment.
+        std::vector<segment> keys;
+        // The offsets past each '\n' in the texts, for the indented partials,
+        // and where those of each text end, see `newlines_of`.
+        std::vector<unsigned> newlines;
+        std::vector<unsigned> newline_ends;
 
         content add(text node)
         {
+            // Catch up with the texts pushed without `add`.
+            while (newline_ends.size() < texts.size())
+                add_newlines(texts[newline_ends.size()]);
             content ret{type::text, unsigned(texts.size())};
             texts.push_back(node);
+            add_newlines(node);
             return ret;
         }
 
+        // `node` must be in `texts`. The newlines of a text pushed without
+        // `add` aren't recorded, they're found into `buf` instead.
+        std::span<unsigned const> newlines_of(text const* node, std::vector<unsigned>& buf) const
+        {
+            auto const i = std::size_t(node - texts.data());
+            if (i < newline_ends.size())
+            {
+                auto const b = i ? newline_ends[i - 1] : 0;
+                return {newlines.data() + b, newline_ends[i] - b};
+            }
+            buf.clear();
+            find_newlines(*node, buf);
+            return buf;
+        }
+
+        static void find_newlines(text node, std::vector<unsigned>& out)
+        {
+            for (std::size_t i = 0; (i = node.find('\n', i)) != node.npos;)
+                out.push_back(unsigned(++i));
+        }
+
+        void add_newlines(text node)
+        {
+            find_newlines(node, newlines);
+            newline_ends.push_back(unsigned(newlines.size()));
+        }
+
         content add(type kind, variable&& node)
         {
+            std::string_view const name(node.key.data(), node.split ? node.split : node.key.size());
+            add_path(name, node.path, node.path_size);
             content ret{kind, unsigned(variables.size())};
             variables.push_back(std::move(node));
             return ret;
@@ -84,6 +205,7 @@ namespace bustache::ast
 
         content add(type kind, block&& node)
         {
+            add_path(node.key, node.path, node.path_size);
             content ret{kind, unsigned(blocks.size())};
             blocks.push_back(std::move(node));
             return ret;
@@ -96,6 +218,20 @@ namespace bustache::ast
             return ret;
         }
 
+        void add_path(std::string_view key, unsigned& path, unsigned& size)
+        {
+            path = unsigned(keys.size());
+            if (key.starts_with('.'))
+                key.remove_prefix(1);
+            if (!key.empty())
+            {
+                for (std::size_t n; (n = key.find('.')) != key.npos; key.remove_prefix(n + 1))
+                    keys.emplace_back(key.substr(0, n));
+                keys.emplace_back(key);
+            }
+            size = unsigned(keys.size() - path);
+        }
+
     public:
         template<class F>
         auto visit(F&& f, content c) const -> decltype(auto)
@@ -129,6 +265,159 @@ namespace bustache::ast
         context const& ctx;
         content_list const& contents;
     };
+
+    // A segment of a key in `program`, with the chars in the pool.
+    struct packed_segment
+    {
+        unsigned str;
+        unsigned size;
+        std::size_t hash;
+    };
+
+    // A node of `program`. The children of a node follow it, and each list
+    // of children (including the top-level one) ends with a `null` node.
+    // The overriders of a partial follow it, as `inheritance` nodes.
+    struct instruction
+    {
+        type kind;
+        // For blocks (and overriders), the distance to the end of the body
+        // + 1, and for partials, to the end of the overriders + 1.
+        unsigned arg;
+        // The text or the key, in the pool.
+        unsigned str;
+        unsigned size;
+        // For variables and blocks, the segments of the key, and for texts,
+        // the offsets past each '\n', in the tables of the program.
+        unsigned first;
+        unsigned count;
+        // For variables, `variable::split`, for blocks, the index in
+        // `context::blocks` of `program::doc`, and for partials, the size of
+        // the indent, which follows the key in the pool.
+        unsigned aux;
+        // For variables, the parsed spec + 1, and for partials, the slot + 1,
+        // or 0 if none.
+        unsigned extra;
+    };
+
+    // A document in one allocation, see `format::compile`. It holds, in order:
+    // * the segments of the keys, as `context::keys`;
+    // * the slots of the partials;
+    // * the nodes, see `instruction`;
+    // * the offsets past each '\n' in the texts;
+    // * the chars of the texts and of the keys, the latter null-terminated.
+    // The parsed specs are shared with the document, aside. The document is
+    // only rebuilt if asked, see `doc`.
+    class program
+    {
+        // The offsets in `_data`.
+        struct layout
+        {
+            std::size_t size = 0;
+            std::size_t slots = 0;
+            std::size_t code = 0;
+            std::size_t newlines = 0;
+            std::size_t pool = 0;
+            std::size_t key_count = 0;
+        };
+
+        std::unique_ptr<std::byte[]> _data;
+        layout _layout;
+        std::vector<std::shared_ptr<format_spec const>> _specs;
+        mutable std::atomic<document const*> _doc = nullptr;
+
+        template<class T>
+        T const* at(std::size_t offset) const noexcept
+        {
+            return reinterpret_cast<T const*>(_data.get() + offset);
+        }
+
+    public:
+        program() = default;
+
+        BUSTACHE_API explicit program(document const& doc);
+
+        program(program const& other)
+          : _data(other._data ? new std::byte[other._layout.size] : nullptr)
+          , _layout(other._layout), _specs(other._specs)
+        {
+            if (_data)
+                std::memcpy(_data.get(), other._data.get(), _layout.size);
+        }
+
+        program(program&& other) noexcept
+          : _data(std::move(other._data))
+          , _layout(std::exchange(other._layout, {}))
+          , _specs(std::move(other._specs))
+          , _doc(other._doc.exchange(nullptr, std::memory_order_relaxed))
+        {}
+
+        program& operator=(program&& other) noexcept
+        {
+            if (this != &other)
+            {
+                _data = std::move(other._data);
+                _layout = std::exchange(other._layout, {});
+                _specs = std::move(other._specs);
+                delete _doc.exchange(other._doc.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            return *this;
+        }
+
+        program& operator=(program const& other)
+        {
+            return operator=(program(other));
+        }
+
+        ~program()
+        {
+            delete _doc.load(std::memory_order_relaxed);
+        }
+
+        explicit operator bool() const noexcept { return !!_data; }
+
+        instruction const* code() const noexcept
+        {
+            return at<instruction>(_layout.code);
+        }
+
+        std::span<packed_segment const> keys() const noexcept
+        {
+            return {at<packed_segment>(0), _layout.key_count};
+        }
+
+        partial_slot const* slot(unsigned i) const noexcept
+        {
+            return at<partial_slot const*>(_layout.slots)[i];
+        }
+
+        std::shared_ptr<format_spec const> const& spec(unsigned i) const noexcept
+        {
+            return _specs[i];
+        }
+
+        char const* pool() const noexcept
+        {
+            return at<char>(_layout.pool);
+        }
+
+        // The text or the key of `node`.
+        std::string_view str(instruction const& node) const noexcept
+        {
+            return {pool() + node.str, node.size};
+        }
+
+        std::span<unsigned const> newlines(instruction const& text) const noexcept
+        {
+            return {at<unsigned>(_layout.newlines) + text.first, text.count};
+        }
+
+        // The document rebuilt from the program, whose texts are in the pool.
+        BUSTACHE_API document to_document() const;
+
+        // Same as `to_document`, but only rebuilt once, e.g. for the views of
+        // the lambdas, and kept as long as the program.
+        BUSTACHE_API document const& doc() const;
+    };
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,273 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_BIND_HPP_INCLUDED
+#define BUSTACHE_BIND_HPP_INCLUDED
+
+#include <bustache/model.hpp>
+#include <algorithm>
+#include <memory>
+
+namespace bustache::detail
+{
+    // What's known about the values of a type ahead of rendering.
+    // A null `static_type` means nothing is known, e.g. for the compatible
+    // types, which are only known at render time.
+    struct static_type
+    {
+        model kind;
+        // Non-null if `ObjectSlot`.
+        object_trait const* object;
+        // Non-null if `impl_object` has `slot_type`.
+        static_type const* (*member)(int slot);
+        // Non-null for the ranges.
+        static_type const* (*element)();
+    };
+
+    template<class T>
+    static_type const* static_type_of();
+
+    template<class T>
+    constexpr object_trait const* static_object_of()
+    {
+        if constexpr (impl_model<T>::kind == model::object && ObjectSlot<T>)
+            return &value_vt<T>;
+        else
+            return nullptr;
+    }
+
+    template<class T>
+    constexpr auto static_member_of() -> static_type const* (*)(int)
+    {
+        if constexpr (requires { {impl_object<T>::slot_type(0)} -> std::same_as<static_type const*>; })
+            return impl_object<T>::slot_type;
+        else
+            return nullptr;
+    }
+
+    template<class T>
+    constexpr auto static_element_of() -> static_type const* (*)()
+    {
+        if constexpr (impl_model<T>::kind == model::list && ValueRange<T>)
+            return static_type_of<ranges::range_value_t<T>>;
+        else
+            return nullptr;
+    }
+
+    template<class T>
+    static_type const* static_type_of()
+    {
+        if constexpr (Model<T>)
+        {
+            static constexpr static_type type
+            {
+                impl_model<T>::kind, static_object_of<T>(),
+                static_member_of<T>(), static_element_of<T>()
+            };
+            return &type;
+        }
+        else
+            return nullptr;
+    }
+
+    // Walks the AST with the types of the scopes known ahead of rendering,
+    // mirroring `content_visitor`, and resolves the keys to the slots where
+    // the types are known.
+    class slot_binder
+    {
+        ast::context const& _ctx;
+        std::vector<std::vector<slot_binding::entry>> _entries;
+        std::vector<static_type const*> _scopes;
+        static_type const* _cursor;
+
+        int add(unsigned key, object_trait const& trait)
+        {
+            auto& entries = _entries[key];
+            for (auto const& e : entries)
+            {
+                if (e.trait == &trait)
+                    return e.slot;
+            }
+            auto const& seg = _ctx.keys[key];
+            auto const slot = trait.slot({seg.str, seg.hash});
+            entries.push_back({&trait, slot});
+            return slot;
+        }
+
+        static_type const* fail(std::string_view key)
+        {
+            if (std::find(unresolved.begin(), unresolved.end(), key) == unresolved.end())
+                unresolved.emplace_back(key);
+            return nullptr;
+        }
+
+        // Returns the type of the value, null if unknown.
+        static_type const* resolve(std::string_view key, unsigned path, unsigned path_size)
+        {
+            if (!path_size)
+                return key.empty() ? nullptr : _cursor;
+            auto i = path;
+            auto const e = path + path_size;
+            static_type const* type = _cursor;
+            if (!key.starts_with('.'))
+            {
+                // Unqualified, look up the scopes from the innermost.
+                auto scope = _scopes.rbegin();
+                for (;; ++scope)
+                {
+                    if (scope == _scopes.rend())
+                        return fail(key);
+                    if (!*scope || !(*scope)->object)
+                        return nullptr;
+                    auto const slot = add(i, *(*scope)->object);
+                    if (slot >= 0)
+                    {
+                        type = (*scope)->member ? (*scope)->member(slot) : nullptr;
+                        break;
+                    }
+                }
+                ++i;
+            }
+            for (; i != e; ++i)
+            {
+                if (!type)
+                    return nullptr;
+                if (!type->object)
+                    return type->kind == model::object ? nullptr : fail(key);
+                auto const slot = add(i, *type->object);
+                if (slot < 0)
+                    return fail(key);
+                type = type->member ? type->member(slot) : nullptr;
+            }
+            return type;
+        }
+
+        // Objects are pushed as the scopes, and so are the unknown ones.
+        void visit_within(static_type const* type, ast::content_list const& contents)
+        {
+            auto const old_cursor = _cursor;
+            bool const push = !type || type->kind == model::object;
+            _cursor = type;
+            if (push)
+                _scopes.push_back(type);
+            visit(contents);
+            if (push)
+                _scopes.pop_back();
+            _cursor = old_cursor;
+        }
+
+    public:
+        std::vector<std::string> unresolved;
+
+        slot_binder(ast::context const& ctx, static_type const* root)
+            : _ctx(ctx), _entries(ctx.keys.size()), _scopes{root}, _cursor(root)
+        {}
+
+        void visit(ast::content_list const& contents)
+        {
+            for (auto const content : contents)
+                _ctx.visit(*this, content);
+        }
+
+        void operator()(ast::type, ast::variable const* variable)
+        {
+            std::string_view key = variable->key;
+            if (auto const split = variable->split)
+                key = std::string_view(key.data(), split);
+            resolve(key, variable->path, variable->path_size);
+        }
+
+        void operator()(ast::type tag, ast::block const* block)
+        {
+            if (tag == ast::type::inheritance)
+                return visit(block->contents);
+            auto const type = resolve(block->key, block->path, block->path_size);
+            if (tag != ast::type::section && tag != ast::type::loop)
+                return visit(block->contents);
+            if (!type)
+                return visit_within(nullptr, block->contents);
+            switch (type->kind)
+            {
+            case model::object:
+                return visit_within(type, block->contents);
+            case model::list:
+                return visit_within(type->element ? type->element() : nullptr, block->contents);
+            case model::atom:
+                if (tag == ast::type::loop)
+                    return visit_within(type, block->contents);
+                [[fallthrough]];
+            default:
+                return visit(block->contents);
+            }
+        }
+
+        void operator()(ast::type, ast::partial const* partial)
+        {
+            for (auto const& overrider : partial->overriders)
+                visit(overrider.second);
+        }
+
+        void operator()(ast::type, void const*) {}
+
+        std::shared_ptr<slot_binding const> result() const
+        {
+            auto ret = std::make_shared<slot_binding>();
+            ret->offsets.reserve(_entries.size() + 1);
+            for (auto const& entries : _entries)
+            {
+                ret->offsets.push_back(unsigned(ret->entries.size()));
+                ret->entries.insert(ret->entries.end(), entries.begin(), entries.end());
+            }
+            ret->offsets.push_back(unsigned(ret->entries.size()));
+            return ret;
+        }
+    };
+}
+
+namespace bustache
+{
+    // A format bound to the data of type `T`. The keys are resolved to the
+    // slots of the members ahead of rendering, as far as the types can be
+    // known (see `ObjectSlot` and `slot_type`), and the keys that can't be
+    // resolved for sure are reported in `unresolved`.
+    template<Model T>
+    class typed_format
+    {
+        format _fmt;
+        std::vector<std::string> _unresolved;
+
+    public:
+        explicit typed_format(format fmt) : _fmt(std::move(fmt))
+        {
+            // Don't keep the document rebuilt from the program.
+            ast::document rebuilt;
+            if (auto const prog = _fmt.program())
+                rebuilt = prog->to_document();
+            auto const& doc = _fmt.compiled() ? rebuilt : _fmt.doc();
+            detail::slot_binder binder(doc.ctx, detail::static_type_of<T>());
+            binder.visit(doc.contents);
+            _fmt.bind_slots(binder.result());
+            _unresolved = std::move(binder.unresolved);
+        }
+
+        format const& get() const noexcept
+        {
+            return _fmt;
+        }
+
+        std::vector<std::string> const& unresolved() const noexcept
+        {
+            return _unresolved;
+        }
+
+        manipulator<detail::manip_core<T>> operator()(T const& data) const
+        {
+            return _fmt(data);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_ESCAPE_HPP_INCLUDED
+#define BUSTACHE_ESCAPE_HPP_INCLUDED
+
+#include <bustache/render.hpp>
+
+namespace bustache::detail
+{
+    template<std::size_t N>
+    struct escape_pool
+    {
+        char str[256][N];
+    };
+
+    // "\u0000" to "\u001f".
+    constexpr escape_pool<6> make_json_pool() noexcept
+    {
+        escape_pool<6> ret{};
+        for (unsigned c = 0; c != 0x20; ++c)
+        {
+            auto& s = ret.str[c];
+            s[0] = '\\', s[1] = 'u', s[2] = '0', s[3] = '0';
+            s[4] = "0123456789abcdef"[c >> 4];
+            s[5] = "0123456789abcdef"[c & 15];
+        }
+        return ret;
+    }
+
+    // "%00" to "%FF".
+    constexpr escape_pool<3> make_url_pool() noexcept
+    {
+        escape_pool<3> ret{};
+        for (unsigned c = 0; c != 256; ++c)
+        {
+            auto& s = ret.str[c];
+            s[0] = '%';
+            s[1] = "0123456789ABCDEF"[c >> 4];
+            s[2] = "0123456789ABCDEF"[c & 15];
+        }
+        return ret;
+    }
+
+    inline constexpr auto json_pool = make_json_pool();
+    inline constexpr auto url_pool = make_url_pool();
+
+    constexpr strlit get_json_escaped(char c) noexcept
+    {
+        switch (c)
+        {
+        case '"': return "\\\"";
+        case '\\': return "\\\\";
+        case '\b': return "\\b";
+        case '\f': return "\\f";
+        case '\n': return "\\n";
+        case '\r': return "\\r";
+        case '\t': return "\\t";
+        }
+        auto const u = static_cast<unsigned char>(c);
+        if (u < 0x20)
+            return {json_pool.str[u], 6};
+        return {};
+    }
+
+    // Everything but the unreserved characters in RFC 3986.
+    constexpr strlit get_url_escaped(char c) noexcept
+    {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+            return {};
+        switch (c)
+        {
+        case '-':
+        case '.':
+        case '_':
+        case '~':
+            return {};
+        }
+        return {url_pool.str[static_cast<unsigned char>(c)], 3};
+    }
+
+    constexpr strlit get_xml_attr_escaped(char c) noexcept
+    {
+        switch (c)
+        {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '"': return "&quot;";
+        case '\'': return "&apos;";
+        // Otherwise normalized to spaces by the XML parser.
+        case '\t': return "&#9;";
+        case '\n': return "&#10;";
+        case '\r': return "&#13;";
+        }
+        // Other control characters are not allowed in XML 1.0.
+        if (static_cast<unsigned char>(c) < 0x20)
+            return "\xef\xbf\xbd";
+        return {};
+    }
+
+    // For use inside single quotes, e.g. `echo '{{name}}'`.
+    constexpr strlit get_shell_escaped(char c) noexcept
+    {
+        if (c == '\'')
+            return "'\\''";
+        return {};
+    }
+
+    inline constexpr escape_table json_escapes = make_escape_table(get_json_escaped);
+    inline constexpr escape_table url_escapes = make_escape_table(get_url_escaped);
+    inline constexpr escape_table xml_attr_escapes = make_escape_table(get_xml_attr_escaped);
+    inline constexpr escape_table shell_escapes = make_escape_table(get_shell_escaped);
+}
+
+namespace bustache
+{
+    // The content of a JSON string, without the quotes.
+    constexpr escape_action<detail::json_escapes> escape_json{};
+
+    // Percent-encoding for a URL component.
+    constexpr escape_action<detail::url_escapes> escape_url{};
+
+    // The value of an XML attribute, in either quotes.
+    constexpr escape_action<detail::xml_attr_escapes> escape_xml_attr{};
+
+    // The content of a POSIX shell single-quoted string.
+    constexpr escape_action<detail::shell_escapes> escape_shell{};
+}
+
+#endif
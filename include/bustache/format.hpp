@@ -13,23 +13,14 @@
 #include <utility>
 #include <memory>
 
-#if defined(_WIN32)
-#   ifdef BUSTACHE_EXPORT
-#       define BUSTACHE_API __declspec(dllexport)
-#   elif defined(BUSTACHE_SHARED)
-#       define BUSTACHE_API __declspec(dllimport)
-#   endif
-#endif
-#ifndef BUSTACHE_API
-#   define BUSTACHE_API
-#endif
-
 namespace bustache
 {
     struct format;
 
     namespace detail
     {
+        struct slot_binding;
+
         template<class T>
         struct manip_core
         {
@@ -72,7 +63,8 @@ namespace bustache
         error_baddelim,
         error_delim,
         error_section,
-        error_badkey
+        error_badkey,
+        error_badspec
     };
 
     class format_error : public std::runtime_error
@@ -94,25 +86,37 @@ namespace bustache
         explicit format(std::string_view source)
         {
             init(source.data(), source.data() + source.size());
+#if defined(BUSTACHE_COMPILE_FORMATS)
+            compile();
+#endif
         }
 
         format(std::string_view source, bool copytext)
         {
             init(source.data(), source.data() + source.size());
-            if (copytext)
+#if defined(BUSTACHE_COMPILE_FORMATS)
+            compile();
+#endif
+            // The program has its own copy of the texts.
+            if (copytext && !compiled())
                 copy_text(text_size());
         }
 
         format(ast::document doc, bool copytext)
           : _doc(std::move(doc))
         {
-            if (copytext)
+#if defined(BUSTACHE_COMPILE_FORMATS)
+            compile();
+#endif
+            // The program has its own copy of the texts.
+            if (copytext && !compiled())
                 copy_text(text_size());
         }
 
         format(format&& other) = default;
 
-        format(format const& other) : _doc(other._doc)
+        format(format const& other)
+          : _doc(other._doc), _code(other._code), _slots(other._slots)
         {
             if (other._text)
                 copy_text(text_size());
@@ -131,9 +135,37 @@ namespace bustache
             return {*this, data};
         }
 
-        ast::document const& doc() const noexcept
+        // If compiled, the document is rebuilt from the program on the
+        // first call, see `ast::program::doc`.
+        ast::document const& doc() const
+        {
+            return _code ? _code.doc() : _doc;
+        }
+
+        // Flatten the document into a linear program in one allocation,
+        // which the renderer will run instead of walking the AST. The
+        // program has the texts, the document is released.
+        BUSTACHE_API void compile();
+
+        bool compiled() const noexcept
+        {
+            return !!_code;
+        }
+
+        ast::program const* program() const noexcept
+        {
+            return _code ? &_code : nullptr;
+        }
+
+        // The slots of the keys resolved ahead of rendering, see `typed_format`.
+        void bind_slots(std::shared_ptr<detail::slot_binding const> slots) noexcept
+        {
+            _slots = std::move(slots);
+        }
+
+        detail::slot_binding const* bound_slots() const noexcept
         {
-            return _doc;
+            return _slots.get();
         }
         
     private:
@@ -143,6 +175,8 @@ namespace bustache
 
         ast::document _doc;
         std::unique_ptr<char[]> _text;
+        ast::program _code;
+        std::shared_ptr<detail::slot_binding const> _slots;
     };
 
     inline namespace literals
@@ -0,0 +1,34 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_LINK_HPP_INCLUDED
+#define BUSTACHE_LINK_HPP_INCLUDED
+
+#include <bustache/render.hpp>
+
+namespace bustache
+{
+    // Splices the partials named statically in `fmt`, as found by `context`,
+    // into a self-contained format, with their indentation applied, so that
+    // rendering it does no partial lookup. The parents, i.e.
+    // `{{<parent}}...{{/parent}}`, are spliced with their blocks resolved to
+    // the overriding content, so that rendering them does no override lookup.
+    //
+    // These are left as they are, to be looked up at render time:
+    // * The dynamic names, e.g. `{{>*name}}`.
+    // * The recursive partials, and those not found.
+    // * The indented partials that contain any of the above, or an
+    //   inheritance block, or where the start of a line can't be told ahead,
+    //   since the indent can't be applied to them.
+    // * The parents that contain any of the above, since the overriders
+    //   can't be applied to them.
+    //
+    // Note that a lazy format under an indented partial is not indented once
+    // the partial is spliced, nor is it overridden under a spliced parent.
+    BUSTACHE_API format link(format const& fmt, context_handler context);
+}
+
+#endif
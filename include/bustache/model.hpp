@@ -10,6 +10,7 @@
 #include <bustache/format.hpp>
 #include <version> 
 #include <vector>
+#include <charconv>
 #include <cstring>
 #include <concepts>
 #include <functional>
@@ -102,7 +103,7 @@ namespace bustache::detail
         fn_base(F const& f) noexcept : _data(&f), _call(call<F>) {}
 
         template<class F>
-        fn_base(F* f) noexcept : _data(f), _call(call_fp<F>) {}
+        fn_base(F* f) noexcept : _data(reinterpret_cast<void const*>(f)), _call(call_fp<F>) {}
 
         R operator()(T... t) const
         {
@@ -118,14 +119,16 @@ namespace bustache::detail
         template<class F>
         static R call_fp(void const* f, T&&... t)
         {
-            return static_cast<F*>(f)(std::forward<T>(t)...);
+            return reinterpret_cast<F*>(const_cast<void*>(f))(std::forward<T>(t)...);
         }
 
         void const* _data;
         R(*_call)(void const*, T&&...);
     };
 
+    template<class Os, class EscapeOs, class Context, class Unresolved>
     struct content_visitor;
+
     struct object_ptr;
 }
 
@@ -205,6 +208,47 @@ namespace bustache
         t.find(key) == t.end();
     } && Value<typename T::mapped_type>;
 
+    // A key for the object lookup, with its hash precomputed by `key_hash`.
+    struct hashed_key
+    {
+        std::string_view str;
+        std::size_t hash;
+
+        operator std::string_view() const noexcept { return str; }
+
+        friend bool operator==(hashed_key const& a, std::string_view b) noexcept
+        {
+            return a.str == b;
+        }
+    };
+
+    // A transparent hasher that takes the precomputed hash of `hashed_key`,
+    // e.g. `std::unordered_map<std::string, V, key_hash, std::equal_to<>>`.
+    struct key_hash
+    {
+        using is_transparent = void;
+
+        std::size_t operator()(std::string_view key) const noexcept
+        {
+            return ast::hash_key(key);
+        }
+
+        std::size_t operator()(hashed_key const& key) const noexcept
+        {
+            return key.hash;
+        }
+    };
+
+    // A `StrValueMap` that can be looked up without rehashing the key.
+    template<class T>
+    concept PrehashedMap = StrValueMap<T> && requires(T const& t, hashed_key const& key)
+    {
+        typename T::hasher::is_transparent;
+        typename T::key_equal::is_transparent;
+        {std::declval<typename T::hasher const&>()(key)} -> std::same_as<std::size_t>;
+        t.find(key);
+    };
+
     template<class T>
     concept Formattable = requires
     {
@@ -291,6 +335,7 @@ namespace bustache
             *this = impl_compatible<T>::get_value_ptr(*p);
         }
 
+        template<class Os, class EscapeOs, class Context, class Unresolved>
         friend struct detail::content_visitor;
         friend struct detail::object_ptr;
 
@@ -314,59 +359,139 @@ namespace bustache
 
 namespace bustache::detail
 {
-    struct output_buffer
+#if !defined(BUSTACHE_USE_FMT)
+    // Writes into a fixed buffer for `std::vformat_to`, and counts what
+    // doesn't fit.
+    struct bounded_iterator
     {
-        using value_type = char;
+        using difference_type = std::ptrdiff_t;
 
-        explicit output_buffer(output_handler os) : os(os) {}
+        char* cur;
+        char* end;
+        std::size_t* excess;
 
-        void push_back(char c)
+        bounded_iterator& operator*() noexcept { return *this; }
+        bounded_iterator& operator++() noexcept { return *this; }
+        bounded_iterator operator++(int) noexcept { return *this; }
+
+        bounded_iterator& operator=(char c) noexcept
         {
-            if (count == sizeof(buf)) [[unlikely]]
-            {
-                flush();
-                count = 0;
-            }
-            buf[count++] = c;
+            if (cur != end) [[likely]]
+                *cur++ = c;
+            else
+                ++*excess;
+            return *this;
         }
-
-        void flush() { os(buf, count); }
-
-        std::size_t count = 0;
-        char buf[1024];
-        output_handler os;
     };
+#endif
 
+    // The output is formatted into a buffer on the stack and passed to `os`
+    // at once, only the long ones go to the heap.
     template<class T>
     void print_fmt(T const& self, output_handler os, char const* spec)
     {
-        using OutIter = std::back_insert_iterator<output_buffer>;
-        output_buffer buf(os);
 #if defined(BUSTACHE_USE_FMT)
-        using FmtCtx = fmt::basic_format_context<OutIter, char>;
+        fmt::memory_buffer buf;
         fmt::formatter<T> fmt;
         if (spec)
         {
+            // Rejects the trailing chars as `vformat_to` does.
             fmt::format_parse_context ctx{spec};
-            fmt.parse(ctx);
+            if (fmt.parse(ctx) != ctx.end())
+                throw fmt::format_error("invalid format specifier");
         }
-        FmtCtx ctx{OutIter(buf), fmt::make_format_args<FmtCtx>()};
+        fmt::format_context ctx{fmt::appender(buf), {}};
         fmt.format(self, ctx);
+        os(buf.data(), buf.size());
 #else
-        if (spec)
+        char buf[512];
+        if (!spec)
+        {
+            auto const n = std::size_t(std::format_to_n(buf, sizeof(buf), "{}", self).size);
+            if (n <= sizeof(buf)) [[likely]]
+                os(buf, n);
+            else
+            {
+                auto const str = std::format("{}", self);
+                os(str.data(), str.size());
+            }
+            return;
+        }
+        // Specs are short, the heap is only for the long chrono ones.
+        auto const len = std::strlen(spec);
+        char small[64];
+        std::unique_ptr<char[]> large;
+        char* tmp = small;
+        if (len + 3 > sizeof(small)) [[unlikely]]
         {
-            const auto len = std::strlen(spec);
-            std::string tmp;
-            tmp.reserve(len + 3);
-            tmp.append("{:", 2);
-            tmp.append(spec, len);
-            tmp.push_back('}');
-            std::vformat_to(OutIter(buf), tmp, fmt::make_format_args(self));
+            large.reset(new char[len + 3]);
+            tmp = large.get();
         }
+        tmp[0] = '{';
+        tmp[1] = ':';
+        std::memcpy(tmp + 2, spec, len);
+        tmp[len + 2] = '}';
+        std::string_view const str(tmp, len + 3);
+        std::size_t excess = 0;
+        auto const e = std::vformat_to(bounded_iterator{buf, buf + sizeof(buf), &excess}, str, fmt::make_format_args(self)).cur;
+        if (!excess) [[likely]]
+            os(buf, e - buf);
         else
-            std::format_to(OutIter(buf), "{}", self);
+        {
+            auto const out = std::vformat(str, fmt::make_format_args(self));
+            os(out.data(), out.size());
+        }
 #endif
-        buf.flush();
+    }
+
+    // The arithmetic types printed with `std::to_chars` directly, without
+    // going through fmt/std::format, see `print_chars` and `print_spec`.
+    template<class T>
+    concept CharsArithmetic = std::is_arithmetic_v<T> && !std::same_as<T, bool> &&
+        !std::same_as<T, char> && !std::same_as<T, wchar_t> && !std::same_as<T, char8_t> &&
+        !std::same_as<T, char16_t> && !std::same_as<T, char32_t> && !std::same_as<T, long double> &&
+        sizeof(T) <= sizeof(long long);
+
+    // The max size written by `print_chars`.
+    inline constexpr std::size_t chars_size = 48;
+
+    // The same as `{}`, return the end.
+    BUSTACHE_API char* print_chars(double self, char* out);
+    BUSTACHE_API char* print_chars(float self, char* out);
+
+    template<CharsArithmetic T> requires std::is_integral_v<T>
+    char* print_chars(T self, char* out)
+    {
+        return std::to_chars(out, out + chars_size, self).ptr;
+    }
+
+    template<CharsArithmetic T>
+    void print_chars(T self, output_handler os)
+    {
+        char buf[chars_size];
+        os(buf, print_chars(self, buf) - buf);
+    }
+
+    // Parse the spec for the `CharsArithmetic` types when the format is
+    // built, return null if none of them takes it.
+    BUSTACHE_API std::shared_ptr<ast::format_spec const> parse_spec(std::string_view spec);
+
+    // Print with the parsed spec, return false if the type doesn't take it,
+    // and the caller should fall back to `print_fmt`, which reports it.
+    BUSTACHE_API bool print_spec(long long self, ast::format_spec const& spec, output_handler os);
+    BUSTACHE_API bool print_spec(unsigned long long self, ast::format_spec const& spec, output_handler os);
+    BUSTACHE_API bool print_spec(double self, ast::format_spec const& spec, output_handler os);
+    BUSTACHE_API bool print_spec(float self, ast::format_spec const& spec, output_handler os);
+
+    template<CharsArithmetic T>
+    bool print_spec(T self, ast::format_spec const& spec, output_handler os)
+    {
+        if constexpr (std::is_floating_point_v<T>)
+            return print_spec(self, spec, os);
+        else if constexpr (std::is_signed_v<T>)
+            return print_spec(static_cast<long long>(self), spec, os);
+        else
+            return print_spec(static_cast<unsigned long long>(self), spec, os);
     }
 
     template<class T>
@@ -436,12 +561,35 @@ namespace bustache::detail
         }
     };
 
+    // `impl_print<T>` can also write to a buffer of `max_size` chars, see
+    // `print_trait::print_to`.
+    template<class T>
+    concept PrintTo = requires(T const& self, char* out)
+    {
+        {impl_print<T>::max_size} -> std::convertible_to<std::size_t>;
+        {impl_print<T>::print_to(self, out)} -> std::same_as<char*>;
+    };
+
     struct print_trait
     {
         constexpr print_trait(...) : print(print_default) {}
 
         template<class T> requires requires{impl_print<T>{};}
-        constexpr print_trait(type<T>) : print(print_impl<T>) {}
+        constexpr print_trait(type<T>) : print(print_impl<T>)
+        {
+            if constexpr (PrintTo<T>)
+            {
+                print_to = print_to_impl<T>;
+                max_size = impl_print<T>::max_size;
+            }
+            else if constexpr (CharsArithmetic<T>)
+            {
+                print_to = print_chars_impl<T>;
+                max_size = chars_size;
+            }
+            if constexpr (CharsArithmetic<T>)
+                print_parsed = print_parsed_impl<T>;
+        }
 
         void(*print)(void const* self, output_handler os, char const* spec);
 
@@ -452,26 +600,179 @@ namespace bustache::detail
         {
             return impl_print<T>::print(deref_data<T>(self), os, spec);
         }
+
+        // Prints with the spec parsed by the format, `str` is the same as is.
+        void print_spec(void const* self, output_handler os, ast::format_spec const* spec, char const* str) const
+        {
+            if (!spec || !print_parsed || !print_parsed(self, os, *spec))
+                print(self, os, str);
+        }
+
+        // Non-null if `CharsArithmetic`, return false if not supported.
+        bool(*print_parsed)(void const* self, output_handler os, ast::format_spec const& spec) = nullptr;
+
+        // Non-null if the output is bounded by `max_size`, for the renderer
+        // to print without a spec into its own buffer, return the end.
+        char*(*print_to)(void const* self, char* out) = nullptr;
+        std::size_t max_size = 0;
+
+        template<class T>
+        static char* print_to_impl(void const* self, char* out)
+        {
+            return impl_print<T>::print_to(deref_data<T>(self), out);
+        }
+
+        template<class T>
+        static char* print_chars_impl(void const* self, char* out)
+        {
+            return detail::print_chars(deref_data<T>(self), out);
+        }
+
+        template<class T>
+        static bool print_parsed_impl(void const* self, output_handler os, ast::format_spec const& spec)
+        {
+            return detail::print_spec(deref_data<T>(self), spec, os);
+        }
+    };
+
+    // `impl_object<T>` has `find`, see `object_trait::get_impl`.
+    template<class T>
+    concept ObjectFind = requires(T const& self, hashed_key const& key)
+    {
+        {impl_object<T>::find(self, key)} -> std::convertible_to<value_ptr>;
+    } || requires(T const& self, std::string const& key)
+    {
+        {impl_object<T>::find(self, key)} -> std::convertible_to<value_ptr>;
+    };
+
+    // `impl_object<T>` maps the keys to the slots of its members, the same
+    // for every object of `T`, so they can be cached, see `object_trait`.
+    template<class T>
+    concept ObjectSlot = requires(T const& self, hashed_key const& key, int slot)
+    {
+        {impl_object<T>::slot(key)} -> std::convertible_to<int>;
+        {impl_object<T>::at(self, slot)} -> std::convertible_to<value_ptr>;
     };
 
     struct object_trait
     {
-        constexpr object_trait(...) : get(get_default) {}
+        constexpr object_trait(...) : get(get_default), find(find_default), slot(), at() {}
 
         template<class T> requires requires{impl_object<T>{};}
-        constexpr object_trait(type<T>) : get(get_impl<T>) {}
+        constexpr object_trait(type<T>)
+            : get(get_impl<T>), find(find_ptr<T>()), slot(slot_ptr<T>()), at(at_ptr<T>())
+        {}
+
+        void(*get)(void const* self, hashed_key const& key, value_handler visit);
+
+        // Null if `impl_object<T>` only has `get`.
+        value_ptr(*find)(void const* self, hashed_key const& key);
 
-        void(*get)(void const* self, std::string const& key, value_handler visit);
+        // Null unless `ObjectSlot<T>`. `slot` returns -1 if there's no such key.
+        int(*slot)(hashed_key const& key);
+        value_ptr(*at)(void const* self, int slot);
 
-        static void get_default(void const*, std::string const&, value_handler visit)
+        static void get_default(void const*, hashed_key const&, value_handler visit)
         {
             visit(nullptr);
         }
 
+        static value_ptr find_default(void const*, hashed_key const&)
+        {
+            return nullptr;
+        }
+
+        // `impl_object<T>::get` can take `hashed_key`, `std::string_view`,
+        // or `std::string const&`, the last one needs a copy of the key.
+        // The same goes for `find`.
+        template<class T>
+        static void get_impl(void const* self, hashed_key const& key, value_handler visit)
+        {
+            if constexpr (ObjectFind<T> || ObjectSlot<T>)
+                return visit(find_impl<T>(self, key));
+            else if constexpr (requires { impl_object<T>::get(deref_data<T>(self), key, visit); })
+                return impl_object<T>::get(deref_data<T>(self), key, visit);
+            else
+                return impl_object<T>::get(deref_data<T>(self), std::string(key.str), visit);
+        }
+
+        template<class T>
+        static value_ptr find_impl(void const* self, hashed_key const& key)
+        {
+            if constexpr (!ObjectFind<T>)
+            {
+                auto const slot = impl_object<T>::slot(key);
+                return slot < 0 ? nullptr : impl_object<T>::at(deref_data<T>(self), slot);
+            }
+            else if constexpr (requires { impl_object<T>::find(deref_data<T>(self), key); })
+                return impl_object<T>::find(deref_data<T>(self), key);
+            else
+                return impl_object<T>::find(deref_data<T>(self), std::string(key.str));
+        }
+
         template<class T>
-        static void get_impl(void const* self, std::string const& key, value_handler visit)
+        static int slot_impl(hashed_key const& key)
         {
-            return impl_object<T>::get(deref_data<T>(self), key, visit);
+            return impl_object<T>::slot(key);
+        }
+
+        template<class T>
+        static value_ptr at_impl(void const* self, int slot)
+        {
+            return impl_object<T>::at(deref_data<T>(self), slot);
+        }
+
+        template<class T>
+        static constexpr auto find_ptr() -> value_ptr(*)(void const*, hashed_key const&)
+        {
+            if constexpr (ObjectFind<T> || ObjectSlot<T>)
+                return find_impl<T>;
+            else
+                return nullptr;
+        }
+
+        template<class T>
+        static constexpr auto slot_ptr() -> int(*)(hashed_key const&)
+        {
+            if constexpr (ObjectSlot<T>)
+                return slot_impl<T>;
+            else
+                return nullptr;
+        }
+
+        template<class T>
+        static constexpr auto at_ptr() -> value_ptr(*)(void const*, int)
+        {
+            if constexpr (ObjectSlot<T>)
+                return at_impl<T>;
+            else
+                return nullptr;
+        }
+    };
+
+    // The slots of the keys in a format, resolved ahead of rendering for the
+    // object types expected there, see `format::bind_slots`.
+    struct slot_binding
+    {
+        struct entry
+        {
+            object_trait const* trait;
+            int slot;
+        };
+
+        // `entries[offsets[i], offsets[i + 1])` are for `ast::context::keys[i]`.
+        std::vector<unsigned> offsets;
+        std::vector<entry> entries;
+
+        entry const* find(std::size_t key, object_trait const& trait) const noexcept
+        {
+            auto const e = entries.data() + offsets[key + 1];
+            for (auto i = entries.data() + offsets[key]; i != e; ++i)
+            {
+                if (i->trait == &trait)
+                    return i;
+            }
+            return nullptr;
         }
     };
 
@@ -616,6 +917,11 @@ namespace bustache
     {
         static void print(T const& self, output_handler os, char const* spec)
         {
+            if constexpr (detail::CharsArithmetic<T>)
+            {
+                if (!spec)
+                    return detail::print_chars(self, os);
+            }
             detail::print_fmt(self, os, spec);
         }
     };
@@ -632,10 +938,18 @@ namespace bustache
     template<StrValueMap T>
     struct impl_object<T>
     {
-        static void get(T const& self, std::string const& key, value_handler visit)
+        static value_ptr find(T const& self, hashed_key const& key)
         {
-            auto const found = self.find(key);
-            visit(found == self.end() ? nullptr : &found->second);
+            auto const found = [&]
+            {
+                if constexpr (PrehashedMap<T>)
+                    return self.find(key);
+                else if constexpr (requires { self.find(key.str); })
+                    return self.find(key.str);
+                else
+                    return self.find(std::string(key.str));
+            }();
+            return found == self.end() ? nullptr : &found->second;
         }
     };
 
@@ -678,13 +992,20 @@ namespace bustache
     template<String K, Value V>
     struct impl_object<std::pair<K, V>>
     {
-        static void get(std::pair<K, V> const& self, std::string const& key, value_handler visit)
+        static int slot(std::string_view key)
         {
             if (key == "key")
-                return visit(&self.first);
+                return 0;
             if (key == "value")
-                return visit(&self.second);
-            return visit(nullptr);
+                return 1;
+            return -1;
+        }
+
+        static value_ptr at(std::pair<K, V> const& self, int slot)
+        {
+            if (slot == 0)
+                return &self.first;
+            return &self.second;
         }
     };
 
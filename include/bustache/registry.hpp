@@ -0,0 +1,295 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_REGISTRY_HPP_INCLUDED
+#define BUSTACHE_REGISTRY_HPP_INCLUDED
+
+#include <bustache/model.hpp>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bustache
+{
+    // An immutable set of templates by name, as published by
+    // `template_registry`. It's a context handler.
+    class template_snapshot : public std::enable_shared_from_this<template_snapshot>
+    {
+    public:
+        using map_type = std::unordered_map<std::string, std::shared_ptr<format const>, key_hash, std::equal_to<>>;
+
+        template_snapshot() = default;
+
+        template_snapshot(map_type map, std::uint64_t version)
+          : _map(std::move(map)), _version(version)
+        {}
+
+        format const* find(std::string_view name) const noexcept
+        {
+            auto const it = _map.find(name);
+            return it == _map.end() ? nullptr : it->second.get();
+        }
+
+        format const* operator()(std::string const& name) const noexcept
+        {
+            return find(name);
+        }
+
+        map_type const& templates() const noexcept
+        {
+            return _map;
+        }
+
+        // The number of updates published before this one.
+        std::uint64_t version() const noexcept
+        {
+            return _version;
+        }
+
+    private:
+        map_type _map;
+        std::uint64_t _version = 0;
+    };
+
+    namespace detail
+    {
+        // A small index for the calling thread, reused once it exits.
+        inline unsigned thread_index()
+        {
+            struct pool
+            {
+                std::mutex mutex;
+                std::vector<unsigned> free;
+                unsigned next = 0;
+            };
+            static pool indices;
+            thread_local struct holder
+            {
+                unsigned i;
+
+                holder()
+                {
+                    std::lock_guard<std::mutex> lock(indices.mutex);
+                    if (indices.free.empty())
+                        i = indices.next++;
+                    else
+                    {
+                        i = indices.free.back();
+                        indices.free.pop_back();
+                    }
+                }
+
+                ~holder()
+                {
+                    std::lock_guard<std::mutex> lock(indices.mutex);
+                    indices.free.push_back(i);
+                }
+            } const h;
+            return h.i;
+        }
+    }
+
+    // Templates that can be reloaded while rendering in other threads.
+    // The readers take a snapshot with no lock and no shared write, and
+    // render with it as the context, e.g.
+    //
+    //     auto const snap = registry.snapshot();
+    //     to_string((*snap->find("page"))(data).context(*snap));
+    //
+    // Each thread has a slot in the registry where it publishes the
+    // snapshot it's using (a hazard pointer), so the readers don't touch
+    // any reference count. The writers publish a new snapshot, where the
+    // unchanged formats are shared with the old one. The old snapshot, and
+    // the formats only it refers to, are freed by the first update after
+    // the renders that use it are done, or with the registry.
+    class template_registry
+    {
+        using snapshot_ptr = std::shared_ptr<template_snapshot const>;
+
+        // Written by its thread only, read by the writers.
+        struct alignas(64) reader_slot
+        {
+            std::atomic<template_snapshot const*> hazard{nullptr};
+            // Held while taking a reference to a newer snapshot than the
+            // one in use.
+            std::atomic<template_snapshot const*> aside{nullptr};
+            unsigned pins = 0;
+        };
+
+        // The slot of thread `i` is in the chunk `k = log2(i + 1)`, which
+        // holds 2^k slots, so the slots never move once allocated.
+        static constexpr unsigned chunk_count = 32;
+
+        reader_slot& slot() const
+        {
+            unsigned const i = detail::thread_index() + 1;
+            unsigned const k = std::bit_width(i) - 1;
+            auto chunk = _chunks[k].load(std::memory_order_acquire);
+            if (!chunk) [[unlikely]]
+            {
+                auto const fresh = new reader_slot[std::size_t(1) << k];
+                if (_chunks[k].compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+                    chunk = fresh;
+                else
+                    delete[] fresh;
+            }
+            return chunk[i - (1u << k)];
+        }
+
+        // Frees the retired snapshots no reader is using.
+        void reclaim()
+        {
+            std::vector<template_snapshot const*> used;
+            for (unsigned k = 0; k != chunk_count; ++k)
+            {
+                auto const chunk = _chunks[k].load(std::memory_order_acquire);
+                if (!chunk)
+                    continue;
+                for (std::size_t i = 0, n = std::size_t(1) << k; i != n; ++i)
+                {
+                    for (auto const& hazard : {std::cref(chunk[i].hazard), std::cref(chunk[i].aside)})
+                    {
+                        if (auto const p = hazard.get().load())
+                            used.push_back(p);
+                    }
+                }
+            }
+            std::erase_if(_retired, [&](snapshot_ptr const& snap)
+            {
+                return std::find(used.begin(), used.end(), snap.get()) == used.end();
+            });
+        }
+
+        // Publishes `snap` in `hazard` once it's checked to be current, which
+        // the writers check after publishing a new one.
+        template_snapshot const* protect(std::atomic<template_snapshot const*>& hazard, template_snapshot const* snap) const noexcept
+        {
+            for (;;)
+            {
+                hazard.store(snap);
+                auto const current = _current.load();
+                if (current == snap) [[likely]]
+                    return snap;
+                snap = current;
+            }
+        }
+
+        mutable std::atomic<reader_slot*> _chunks[chunk_count] = {};
+        // The current snapshot, guarded by `_write_mutex` as is `_retired`.
+        snapshot_ptr _own = std::make_shared<template_snapshot const>();
+        std::atomic<template_snapshot const*> _current{_own.get()};
+        std::vector<snapshot_ptr> _retired;
+        std::mutex _write_mutex;
+
+    public:
+        // The snapshot taken by `snapshot`, for the scope of the render.
+        // Use `share` to keep it longer or pass it to another thread.
+        class pinned_snapshot
+        {
+            friend class template_registry;
+
+            reader_slot* _slot = nullptr; // If pinned in the thread's slot.
+            snapshot_ptr _own; // Otherwise.
+            template_snapshot const* _snap;
+
+            pinned_snapshot(reader_slot& slot, template_snapshot const* snap) noexcept
+              : _slot(&slot), _snap(snap)
+            {
+                ++slot.pins;
+            }
+
+            explicit pinned_snapshot(snapshot_ptr own) noexcept
+              : _own(std::move(own)), _snap(_own.get())
+            {}
+
+        public:
+            pinned_snapshot(pinned_snapshot const&) = delete;
+            pinned_snapshot& operator=(pinned_snapshot const&) = delete;
+
+            ~pinned_snapshot()
+            {
+                if (_slot && !--_slot->pins)
+                    _slot->hazard.store(nullptr, std::memory_order_release);
+            }
+
+            template_snapshot const& operator*() const noexcept { return *_snap; }
+            template_snapshot const* operator->() const noexcept { return _snap; }
+
+            snapshot_ptr share() const
+            {
+                return _snap->shared_from_this();
+            }
+        };
+
+        template_registry() = default;
+        template_registry(template_registry const&) = delete;
+        template_registry& operator=(template_registry const&) = delete;
+
+        ~template_registry()
+        {
+            for (auto& chunk : _chunks)
+                delete[] chunk.load(std::memory_order_relaxed);
+        }
+
+        // Lock-free, it only retries if an update is published meanwhile.
+        pinned_snapshot snapshot() const
+        {
+            auto& slot = this->slot();
+            auto const snap = _current.load(std::memory_order_acquire);
+            if (!slot.pins) [[likely]]
+                return {slot, protect(slot.hazard, snap)};
+            // Already in use by this thread, e.g. a partial taking a snapshot.
+            if (slot.hazard.load(std::memory_order_relaxed) == snap)
+                return {slot, snap};
+            auto own = protect(slot.aside, snap)->shared_from_this();
+            slot.aside.store(nullptr, std::memory_order_release);
+            return pinned_snapshot(std::move(own));
+        }
+
+        // Publishes a copy of the current templates as modified by `f`.
+        template<class F>
+        void update(F const& f)
+        {
+            std::lock_guard<std::mutex> lock(_write_mutex);
+            auto map = _own->templates();
+            f(map);
+            auto desired = std::make_shared<template_snapshot const>(std::move(map), _own->version() + 1);
+            _current.store(desired.get());
+            _retired.push_back(std::exchange(_own, std::move(desired)));
+            reclaim();
+        }
+
+        // Adds or reloads the template, the text is copied.
+        void add(std::string_view name, format const& fmt)
+        {
+            // The program has its own texts.
+            std::shared_ptr<format const> const shared = fmt.compiled() ?
+                std::make_shared<format const>(fmt) :
+                std::make_shared<format const>(ast::document(fmt.doc()), true);
+            update([&](template_snapshot::map_type& map)
+            {
+                map.insert_or_assign(std::string(name), shared);
+            });
+        }
+
+        void erase(std::string_view name)
+        {
+            update([&](template_snapshot::map_type& map)
+            {
+                if (auto const it = map.find(name); it != map.end())
+                    map.erase(it);
+            });
+        }
+    };
+}
+
+#endif
@@ -8,6 +8,8 @@
 #define BUSTACHE_RENDER_HPP_INCLUDED
 
 #include <bustache/model.hpp>
+#include <cstdint>
+#include <cstring>
 
 namespace bustache
 {
@@ -72,13 +74,17 @@ namespace bustache::detail
         template<std::size_t N>
         constexpr strlit(char const (&str)[N]) : data(str), size(N - 1) {}
 
+        constexpr strlit(char const* data, std::size_t size) : data(data), size(size) {}
+
+        // Not testing `data`, comparing a pointer into a constexpr pool
+        // isn't a constant expression under -fsanitize=null.
         constexpr explicit operator bool() const
         {
-            return !!data;
+            return size != 0;
         }
     };
 
-    inline strlit get_escaped(char c) noexcept
+    constexpr strlit get_escaped(char c) noexcept
     {
         switch (c)
         {
@@ -91,36 +97,256 @@ namespace bustache::detail
         }
     }
 
+    // A set of bytes laid out for nibble lookup, see src/scan.hpp.
+    struct byte_set
+    {
+        std::uint8_t bits[32] = {};
+
+        constexpr void insert(unsigned char c) noexcept
+        {
+            bits[(c & 15u) | ((c >> 3) & 16u)] |= std::uint8_t(1u << ((c >> 4) & 7u));
+        }
+
+        constexpr bool contains(unsigned char c) const noexcept
+        {
+            return bits[(c & 15u) | ((c >> 3) & 16u)] & (1u << ((c >> 4) & 7u));
+        }
+    };
+
+    // The bytes to escape, and what to replace them with.
+    struct escape_table
+    {
+        byte_set set;
+        byte_set utf8_set; // Plus all the non-ASCII bytes, for validation.
+        strlit subst[256];
+    };
+
+    template<class F>
+    constexpr escape_table make_escape_table(F f) noexcept
+    {
+        escape_table ret{};
+        for (unsigned c = 0; c != 256; ++c)
+        {
+            auto const u = static_cast<unsigned char>(c);
+            if (auto const str = f(char(c)))
+            {
+                ret.set.insert(u);
+                ret.utf8_set.insert(u);
+                ret.subst[c] = str;
+            }
+            else if (c >= 0x80)
+                ret.utf8_set.insert(u);
+        }
+        return ret;
+    }
+
+    inline constexpr escape_table html_escapes = make_escape_table(get_escaped);
+
+    // Return the length of the well-formed UTF-8 sequence at `p`, or the
+    // negated length of its maximal ill-formed subpart.
+    constexpr int utf8_sequence(char const* p, char const* e) noexcept
+    {
+        auto const c = static_cast<unsigned char>(*p);
+        if (c < 0x80)
+            return 1;
+        int n;
+        unsigned lo = 0x80, hi = 0xbf; // Range of the 2nd byte.
+        if (c < 0xc2)
+            return -1;
+        else if (c < 0xe0)
+            n = 2;
+        else if (c < 0xf0)
+        {
+            n = 3;
+            if (c == 0xe0) // Overlong.
+                lo = 0xa0;
+            else if (c == 0xed) // Surrogates.
+                hi = 0x9f;
+        }
+        else if (c < 0xf5)
+        {
+            n = 4;
+            if (c == 0xf0) // Overlong.
+                lo = 0x90;
+            else if (c == 0xf4) // Beyond U+10FFFF.
+                hi = 0x8f;
+        }
+        else
+            return -1;
+        for (int k = 1; k != n; ++k, lo = 0x80, hi = 0xbf)
+        {
+            if (p + k == e)
+                return -k;
+            auto const b = static_cast<unsigned char>(p[k]);
+            if (b < lo || b > hi)
+                return -k;
+        }
+        return n;
+    }
+
+    // Find the first byte in [i, e) that is in `set`, 16 or 32 bytes at a time
+    // if the CPU supports it.
+    BUSTACHE_API char const* find_escape(char const* i, char const* e, byte_set const& set) noexcept;
+
+    // Find the first byte in [i, e) that is `c`, `e` if not found.
+    BUSTACHE_API char const* find_byte(char const* i, char const* e, char c) noexcept;
+
+    // Collects the unescaped runs and the replacements, so that the sink
+    // is called once in a while instead of twice per escaped byte.
+    template<class Sink>
+    struct escape_staging
+    {
+        static constexpr std::size_t capacity = 512;
+
+        Sink const& sink;
+        std::size_t count = 0;
+        char buf[capacity];
+
+        explicit escape_staging(Sink const& sink) noexcept : sink(sink) {}
+
+        void append(char const* data, std::size_t n)
+        {
+            if (n > capacity - count)
+            {
+                flush();
+                if (n >= capacity)
+                {
+                    sink(data, n);
+                    return;
+                }
+            }
+            std::memcpy(buf + count, data, n);
+            count += n;
+        }
+
+        void flush()
+        {
+            if (count)
+            {
+                sink(buf, count);
+                count = 0;
+            }
+        }
+    };
+
     template<class Sink>
     struct escape_sink
     {
         Sink const& sink;
+        escape_table const& table = html_escapes;
+        bool validate_utf8 = false;
 
         void operator()(const void* data, std::size_t bytes) const
         {
             auto it = static_cast<char const*>(data);
-            auto last = it;
             auto const end = it + bytes;
-            while (it != end)
+            auto const& set = validate_utf8 ? table.utf8_set : table.set;
+            auto p = find_escape(it, end, set);
+            if (p == end) // Nothing to escape, the common case.
+                return sink(it, bytes);
+            escape_staging<Sink> staging{sink};
+            for (;;)
+            {
+                staging.append(it, p - it);
+                if (p == end)
+                    break;
+                // Escapes tend to come in groups, no need to go through
+                // the kernel for adjacent ones.
+                do
+                    p = escape_one(staging, p, end);
+                while (p != end && set.contains(static_cast<unsigned char>(*p)));
+                it = p;
+                p = find_escape(it, end, set);
+            }
+            staging.flush();
+        }
+
+    private:
+        bool escapes_any(char const* p, char const* q) const noexcept
+        {
+            for (; p != q; ++p)
             {
-                if (auto const str = get_escaped(*it))
+                if (table.set.contains(static_cast<unsigned char>(*p)))
+                    return true;
+            }
+            return false;
+        }
+
+        // Copy the valid sequence [p, q) along with the valid ones that
+        // follow, in one go, since the kernel stops at each non-ASCII byte.
+        char const* skip_utf8(escape_staging<Sink>& staging, char const* p, char const* q, char const* end) const
+        {
+            while (q != end && static_cast<unsigned char>(*q) >= 0x80)
+            {
+                auto const n = utf8_sequence(q, end);
+                if (n < 0 || escapes_any(q, q + n))
+                    break;
+                q += n;
+            }
+            staging.append(p, q - p);
+            return q;
+        }
+
+        void escape_byte(escape_staging<Sink>& staging, char const* p) const
+        {
+            if (auto const str = table.subst[static_cast<unsigned char>(*p)])
+                staging.append(str.data, str.size);
+            else
+                staging.append(p, 1);
+        }
+
+        char const* escape_one(escape_staging<Sink>& staging, char const* p, char const* end) const
+        {
+            if (validate_utf8)
+            {
+                auto const n = utf8_sequence(p, end);
+                if (n < 0) // Replace with U+FFFD.
                 {
-                    sink(last, it - last);
-                    sink(str.data, str.size);
-                    last = ++it;
+                    static constexpr char replacement[] = "\xef\xbf\xbd";
+                    for (char const& c : std::string_view(replacement, 3))
+                        escape_byte(staging, &c);
+                    return p - n;
                 }
-                else
-                    ++it;
+                auto const q = p + n;
+                if (!escapes_any(p, q))
+                    return skip_utf8(staging, p, q, end);
+                for (; p != q; ++p)
+                    escape_byte(staging, p);
+                return p;
             }
-            sink(last, it - last);
+            escape_byte(staging, p);
+            return p + 1;
         }
     };
 
+    // `section_end` is called at the end of each top-level section.
     BUSTACHE_API void render
     (
         output_handler raw_os, output_handler escape_os, format const& fmt, value_ptr data,
-        context_handler context, unresolved_handler f
+        context_handler context, unresolved_handler f, fn_ptr<void()> section_end = nullptr
     );
+
+    // Let the sink know the rendering is done, even if it's due to an
+    // exception, so the output so far is kept as with an unbuffered sink.
+    template<class Sink, class F>
+    void render_and_end(Sink const& os, F const& f)
+    {
+        if constexpr (requires { os.render_end(); })
+        {
+            try
+            {
+                f();
+            }
+            catch (...)
+            {
+                os.render_end();
+                throw;
+            }
+            os.render_end();
+        }
+        else
+            f();
+    }
 }
 
 namespace bustache
@@ -135,11 +361,27 @@ namespace bustache
 
     constexpr no_escape_t no_escape{};
 
-    constexpr auto escape_html = []<class Sink>(Sink const& sink)
+    // Escape the bytes according to `Table`, optionally replacing the
+    // ill-formed UTF-8 with U+FFFD in the same pass.
+    template<detail::escape_table const& Table>
+    struct escape_action
     {
-        return detail::escape_sink<Sink>{sink};
+        bool utf8 = false;
+
+        template<class Sink>
+        detail::escape_sink<Sink> operator()(Sink const& sink) const
+        {
+            return {sink, Table, utf8};
+        }
+
+        constexpr escape_action validate_utf8() const noexcept
+        {
+            return {true};
+        }
     };
 
+    constexpr escape_action<detail::html_escapes> escape_html{};
+
     namespace detail
     {
         inline no_escape_t get_escape(void const*)
@@ -168,7 +410,14 @@ namespace bustache
         unresolved_handler f = nullptr
     )
     {
-        detail::render(os, escape(os), fmt, data.get_ptr(), context, f);
+        detail::render_and_end(os, [&]
+        {
+            // Let the sink know where the sections end, e.g. `buffered_sink`.
+            if constexpr (requires { os.section_end(); })
+                detail::render(os, escape(os), fmt, data.get_ptr(), context, f, [&os] { os.section_end(); });
+            else
+                detail::render(os, escape(os), fmt, data.get_ptr(), context, f);
+        });
     }
 }
 
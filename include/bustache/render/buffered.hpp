@@ -0,0 +1,82 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_RENDER_BUFFERED_HPP_INCLUDED
+#define BUSTACHE_RENDER_BUFFERED_HPP_INCLUDED
+
+#include <cstring>
+#include <bustache/render.hpp>
+
+namespace bustache
+{
+    enum class flush_policy
+    {
+        size,    // When the buffer is full, and at the end of rendering.
+        section, // Also at the end of each top-level section.
+        manual   // Only when the buffer is full, the rest is up to `flush()`.
+    };
+
+    // Collects the output in a fixed buffer and forwards it to `Sink` in
+    // blocks of `N` bytes at most, except for the writes larger than the
+    // buffer, which are forwarded as is.
+    template<class Sink, std::size_t N = 4096, flush_policy Policy = flush_policy::size>
+    class buffered_sink
+    {
+        Sink _sink;
+        mutable std::size_t _count = 0;
+        mutable char _buf[N];
+
+    public:
+        static constexpr std::size_t capacity = N;
+
+        explicit buffered_sink(Sink sink) : _sink(std::move(sink)) {}
+
+        buffered_sink(buffered_sink const&) = delete;
+        buffered_sink& operator=(buffered_sink const&) = delete;
+
+        void operator()(char const* data, std::size_t bytes) const
+        {
+            if (bytes > N - _count)
+            {
+                flush();
+                if (bytes >= N)
+                {
+                    _sink(data, bytes);
+                    return;
+                }
+            }
+            std::memcpy(_buf + _count, data, bytes);
+            _count += bytes;
+        }
+
+        void flush() const
+        {
+            if (_count)
+            {
+                _sink(_buf, _count);
+                _count = 0;
+            }
+        }
+
+        std::size_t pending() const noexcept { return _count; }
+
+        // Called by `render`.
+        void section_end() const
+        {
+            if constexpr (Policy == flush_policy::section)
+                flush();
+        }
+
+        // Called by `render`.
+        void render_end() const
+        {
+            if constexpr (Policy != flush_policy::manual)
+                flush();
+        }
+    };
+}
+
+#endif
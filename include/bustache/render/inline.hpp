@@ -0,0 +1,1204 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2016-2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_RENDER_INLINE_HPP_INCLUDED
+#define BUSTACHE_RENDER_INLINE_HPP_INCLUDED
+
+#include <bustache/render.hpp>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bustache::detail
+{
+    class lookup_cache;
+
+    // A segment of a key in the AST or in a program, with the cache to look
+    // it up. The segment is where the lookups are cached.
+    struct ast_key
+    {
+        std::string_view str;
+        std::size_t hash;
+        void const* seg;
+        lookup_cache& cache;
+    };
+
+    // Caches, for the keys in the AST (or in the program):
+    // * the slots for each object type, see `ObjectSlot`, including the
+    //   misses. The slots bound to the format being rendered are taken first.
+    // * the depth where a key is found from a scope, including the misses,
+    //   so that the scopes that don't have it aren't asked again, e.g. for
+    //   each element of a list, see `lookup`.
+    // The hash is checked as well, in case a temporary format is replaced by
+    // another one at the same address. The entries are kept per thread, and
+    // only valid for the render (resp. scope) of the same id, so that they
+    // don't need clearing.
+    class lookup_cache
+    {
+        struct slot_entry
+        {
+            void const* seg;
+            object_trait const* trait;
+            std::size_t hash;
+            std::uint64_t id;
+            int slot;
+        };
+
+        struct depth_entry
+        {
+            void const* seg;
+            std::size_t hash;
+            std::uint64_t id;
+            int depth;
+        };
+
+        static constexpr std::size_t size = 64;
+
+        struct tables
+        {
+            std::uint64_t last_id = 0;
+            slot_entry slots[size];
+            depth_entry depths[size];
+        };
+
+        static tables& local() noexcept
+        {
+            thread_local tables t;
+            return t;
+        }
+
+        // The segments are at least that far apart.
+        static std::size_t index_of(void const* seg, std::uint64_t id) noexcept
+        {
+            return (reinterpret_cast<std::uintptr_t>(seg) / sizeof(ast::packed_segment) + id) % size;
+        }
+
+    public:
+        // Either `ast::context::keys` or `ast::program::keys`.
+        struct bound_keys
+        {
+            void const* data = nullptr;
+            std::size_t stride = 1;
+            std::size_t size = 0;
+            slot_binding const* binding = nullptr;
+        };
+
+        // Unique in the thread, for the renders and the scopes.
+        static std::uint64_t next_id() noexcept
+        {
+            return ++local().last_id;
+        }
+
+        static bound_keys keys_of(format const& fmt) noexcept
+        {
+            if (auto const prog = fmt.program())
+            {
+                auto const keys = prog->keys();
+                return {keys.data(), sizeof(ast::packed_segment), keys.size(), fmt.bound_slots()};
+            }
+            auto const& keys = fmt.doc().ctx.keys;
+            return {keys.data(), sizeof(ast::segment), keys.size(), fmt.bound_slots()};
+        }
+
+        // Returns the old one.
+        bound_keys bind(bound_keys keys) noexcept
+        {
+            return std::exchange(_bound, keys);
+        }
+
+        int slot(ast_key const& key, object_trait const& trait)
+        {
+            if (_bound.binding)
+            {
+                auto const i = (reinterpret_cast<std::uintptr_t>(key.seg) - reinterpret_cast<std::uintptr_t>(_bound.data)) / _bound.stride;
+                if (i < _bound.size)
+                {
+                    if (auto const e = _bound.binding->find(i, trait))
+                        return e->slot;
+                }
+            }
+            auto& e = _tables.slots[index_of(key.seg, reinterpret_cast<std::uintptr_t>(&trait) / alignof(object_trait))];
+            if (e.seg != key.seg || e.trait != &trait || e.hash != key.hash || e.id != _id)
+                e = {key.seg, &trait, key.hash, _id, trait.slot({key.str, key.hash})};
+            return e.slot;
+        }
+
+        // The depth from `scope` where `key` was found, -1 if nowhere, or
+        // null if not known.
+        int const* depth(ast_key const& key, std::uint64_t scope) const noexcept
+        {
+            auto const& e = _tables.depths[index_of(key.seg, scope)];
+            if (e.seg != key.seg || e.hash != key.hash || e.id != scope)
+                return nullptr;
+            return &e.depth;
+        }
+
+        void set_depth(ast_key const& key, std::uint64_t scope, int depth) noexcept
+        {
+            _tables.depths[index_of(key.seg, scope)] = {key.seg, key.hash, scope, depth};
+        }
+
+    private:
+        tables& _tables = local();
+        std::uint64_t const _id = next_id();
+        bound_keys _bound;
+    };
+
+    // The segments of a key, either `ast::segment` or `ast::packed_segment`,
+    // whose chars are in `pool`.
+    template<class Seg>
+    struct segment_range
+    {
+        Seg const* begin;
+        Seg const* end;
+        char const* pool;
+    };
+
+    inline ast_key key_of(ast::segment const& seg, char const*, lookup_cache& cache) noexcept
+    {
+        return {seg.str, seg.hash, &seg, cache};
+    }
+
+    inline ast_key key_of(ast::packed_segment const& seg, char const* pool, lookup_cache& cache) noexcept
+    {
+        return {{pool + seg.str, seg.size}, seg.hash, &seg, cache};
+    }
+
+    struct object_ptr
+    {
+        void const* data;
+        object_trait const* trait;
+
+        // `val` must be of a model with `value_vtable`.
+        static object_ptr of(value_ptr val)
+        {
+            return {val.data, static_cast<value_vtable const*>(val.vptr)};
+        }
+
+        static object_ptr from(value_ptr val)
+        {
+            if (val.vptr->kind == model::object)
+                return of(val);
+            return {nullptr, &value_vt<void>};
+        }
+
+        static object_ptr from_nested(value_ptr val)
+        {
+            if (val.vptr->kind < model::lazy_value)
+                return of(val);
+            return {nullptr, &value_vt<void>};
+        }
+
+        constexpr explicit operator bool() const { return !!data; }
+
+        // Prefers `find` so `visit` can be inlined.
+        template<class Visit>
+        void get(hashed_key const& key, Visit const& visit) const
+        {
+            if (auto const find = trait->find)
+                visit(find(data, key));
+            else
+                trait->get(data, key, visit);
+        }
+
+        // For the keys that are not known in advance.
+        template<class Visit>
+        void get(std::string_view key, Visit const& visit) const
+        {
+            get(hashed_key{key, ast::hash_key(key)}, visit);
+        }
+
+        template<class Visit>
+        void get(ast_key const& key, Visit const& visit) const
+        {
+            if (trait->slot)
+            {
+                auto const slot = key.cache.slot(key, *trait);
+                visit(slot < 0 ? value_ptr() : trait->at(data, slot));
+            }
+            else
+                get(hashed_key{key.str, key.hash}, visit);
+        }
+    };
+
+    struct content_scope
+    {
+        content_scope const* const parent;
+        object_ptr data;
+        std::uint64_t const id = lookup_cache::next_id();
+    };
+
+    // `Key` is either `hashed_key` or `ast_key`.
+    template<class Key, class Visit>
+    void lookup(content_scope const* scope, Key const& key, Visit const& visit)
+    {
+        bool found = false;
+        auto const get = [&](content_scope const* scope)
+        {
+            scope->data.get(key, [&](value_ptr val)
+            {
+                if (val)
+                {
+                    visit(val);
+                    found = true;
+                }
+            });
+            return found;
+        };
+        if (get(scope))
+            return;
+        auto const parent = scope->parent;
+        if constexpr (std::is_same_v<Key, ast_key>)
+        {
+            // The parents are the same for each element of a list, so where
+            // the key is found from there is cached.
+            if (!parent)
+                return visit(nullptr);
+            if (auto const depth = key.cache.depth(key, parent->id))
+            {
+                if (*depth < 0)
+                    return visit(nullptr);
+                auto p = parent;
+                for (int n = *depth; n; --n)
+                    p = p->parent;
+                if (get(p))
+                    return;
+            }
+            int depth = 0;
+            for (auto p = parent; p; p = p->parent, ++depth)
+            {
+                if (get(p))
+                    return key.cache.set_depth(key, parent->id, depth);
+            }
+            key.cache.set_depth(key, parent->id, -1);
+        }
+        else
+        {
+            for (auto p = parent; p; p = p->parent)
+            {
+                if (get(p))
+                    return;
+            }
+        }
+        visit(nullptr);
+    }
+
+    struct subkey
+    {
+        char const* i;
+        char const* const e;
+
+        constexpr explicit operator bool() const { return i != e; }
+    };
+
+    struct nested_resolver
+    {
+        using iter = char const*;
+        subkey sub;
+        std::string_view last; // The last key tried.
+        value_handler handle;
+        bool done;
+
+        void next(object_ptr obj)
+        {
+            auto const k0 = ++sub.i;
+            while (sub)
+            {
+                if (*sub.i == '.')
+                {
+                    last = std::string_view(k0, sub.i);
+                    return obj.get(last, [this](value_ptr val)
+                    {
+                        if (auto const obj = object_ptr::from(val))
+                            next(obj);
+                    });
+                }
+                else
+                    ++sub.i;
+            }
+            last = std::string_view(k0, sub.i);
+            obj.get(last, [this](value_ptr val)
+            {
+                if (val)
+                {
+                    handle(val);
+                    done = true;
+                }
+            });
+        }
+    };
+
+    // Like `nested_resolver`, but for the pre-split segments.
+    template<class Seg>
+    struct path_resolver
+    {
+        Seg const* i;
+        Seg const* const e;
+        char const* pool;
+        lookup_cache& cache;
+        value_handler handle;
+        bool done;
+
+        void next(object_ptr obj)
+        {
+            obj.get(key_of(*i++, pool, cache), [this](value_ptr val)
+            {
+                if (i != e)
+                {
+                    if (auto const obj = object_ptr::from(val))
+                        next(obj);
+                }
+                else if (val)
+                {
+                    handle(val);
+                    done = true;
+                }
+            });
+        }
+    };
+
+    // The overriders of a partial, either in the AST or in a program, where
+    // they follow the partial.
+    struct override_context
+    {
+        ast::override_map const* map;
+        ast::context const* ctx;
+        ast::instruction const* partial = nullptr;
+        ast::program const* prog = nullptr;
+
+        void const* id() const noexcept
+        {
+            return map ? static_cast<void const*>(map) : partial;
+        }
+    };
+
+    // Either `found` in `ctx` or `body` in `prog`, or none.
+    struct override_find_result
+    {
+        ast::content_list const* found;
+        ast::context const* ctx;
+        ast::instruction const* body = nullptr;
+        ast::program const* prog = nullptr;
+    };
+
+    // The chains of the overriders being rendered, as a tree where each node
+    // extends the chain of its parent, so that the same chain, e.g. in a loop,
+    // is the same node, which caches the blocks resolved against it.
+    // The nodes of the temporary formats aren't kept, since the overriders of
+    // another one may take the same address.
+    class override_chain
+    {
+        struct node
+        {
+            unsigned parent;
+            override_context overriders;
+            std::vector<std::pair<void const*, unsigned>> children;
+            std::unordered_map<std::string, override_find_result, key_hash, std::equal_to<>> found;
+        };
+
+        std::vector<node> _nodes{1}; // The root is the empty chain.
+        std::size_t _stable_size = 0;
+        unsigned _temp_depth = 0;
+        unsigned _current = 0;
+
+        bool stable(unsigned i) const noexcept
+        {
+            return !_temp_depth || i < _stable_size;
+        }
+
+        // The outermost overrider wins.
+        override_find_result resolve(std::string_view key) const
+        {
+            override_find_result ret{};
+            for (auto i = _current; i; i = _nodes[i].parent)
+            {
+                auto const& o = _nodes[i].overriders;
+                if (o.map)
+                {
+                    auto const it = o.map->find(std::string(key));
+                    if (it != o.map->end())
+                        ret = {&it->second, o.ctx};
+                    continue;
+                }
+                auto const e = o.partial + o.partial->arg;
+                for (auto p = o.partial + 1; p != e; p += p->arg)
+                {
+                    if (o.prog->str(*p) == key)
+                    {
+                        ret = {nullptr, nullptr, p + 1, o.prog};
+                        break;
+                    }
+                }
+            }
+            return ret;
+        }
+
+    public:
+        // Returns the old one, to `pop` back to.
+        unsigned push(override_context const& overriders)
+        {
+            auto const old = _current;
+            auto const id = overriders.id();
+            if (!_temp_depth)
+            {
+                for (auto const& [m, i] : _nodes[old].children)
+                {
+                    if (m == id)
+                        return std::exchange(_current, i);
+                }
+            }
+            _current = unsigned(_nodes.size());
+            _nodes.push_back({old, overriders, {}, {}});
+            if (!_temp_depth)
+                _nodes[old].children.emplace_back(id, _current);
+            return old;
+        }
+
+        void pop(unsigned old) noexcept
+        {
+            if (!stable(_current) && _current + 1 == _nodes.size())
+                _nodes.pop_back();
+            _current = old;
+        }
+
+        // Around the rendering of a temporary format.
+        void enter_temp() noexcept
+        {
+            if (!_temp_depth++)
+                _stable_size = _nodes.size();
+        }
+
+        void leave_temp()
+        {
+            if (!--_temp_depth)
+                _nodes.resize(_stable_size);
+        }
+
+        override_find_result find(std::string_view key)
+        {
+            if (!_current)
+                return {};
+            if (!stable(_current))
+                return resolve(key);
+            auto& found = _nodes[_current].found;
+            auto const it = found.find(key);
+            if (it != found.end())
+                return it->second;
+            auto const ret = resolve(key);
+            found.emplace(key, ret);
+            return ret;
+        }
+    };
+
+    // The largest `print_trait::max_size` printed on the stack.
+    inline constexpr std::size_t print_to_size = 256;
+
+    // The rendering engine. The sinks and the handlers are used as is, so they
+    // can be either the type-erased ones or the concrete ones for inlining.
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    struct content_visitor
+    {
+        using result_type = void;
+
+        // The specs of `{{var:spec}}`, `str` is null if none.
+        struct spec_ref
+        {
+            ast::format_spec const* parsed;
+            char const* str;
+        };
+
+        ast::context const* ctx; // Of the document being walked.
+        ast::program const* prog; // Being run.
+        content_scope const* scope;
+        value_ptr cursor;
+        override_chain chain;
+        mutable std::string key_cache;
+        // The partials by name, including the misses, so the context handler
+        // is asked once per name in a render, see `find_partial`.
+        std::unordered_map<std::string, format const*, key_hash, std::equal_to<>> partials;
+        std::string indented; // The text with the indent, see `write_indented`.
+        std::vector<unsigned> lines; // Of the texts not recorded, see `handle_text`.
+        lookup_cache lookups;
+
+        Os const& raw_os;
+        EscapeOs const& escape_os;
+        Context const& context;
+        Unresolved const& variable_unresolved;
+        fn_ptr<void()> section_end;
+        std::string indent;
+        unsigned section_depth;
+        bool needs_indent;
+
+        content_visitor
+        (
+            content_scope const& scope, value_ptr cursor,
+            Os const& raw_os, EscapeOs const& escape_os, Context const& context,
+            Unresolved const& f, fn_ptr<void()> section_end
+        )
+            : ctx(), prog(), scope(&scope), cursor(cursor)
+            , raw_os(raw_os), escape_os(escape_os), context(context)
+            , variable_unresolved(f), section_end(section_end)
+            , section_depth(), needs_indent()
+        {}
+
+        content_visitor(content_visitor const&) = delete;
+
+        template<class Visit>
+        void resolve(std::string_view key, Visit visit) const
+        {
+            auto ki = key.data();
+            auto const ke = ki + key.size();
+            if (ki == ke)
+                return visit(nullptr, subkey{ki, ke});
+            if (*ki == '.')
+            {
+                subkey sub{ki, ke};
+                if (++ki == ke)
+                    sub.i = ki;
+                return visit(cursor, sub);
+            }
+            // Unqualified.
+            auto const k0 = ki;
+            while (ki != ke && *ki != '.') ++ki;
+            std::string_view const head(k0, ki);
+            lookup(scope, hashed_key{head, ast::hash_key(head)}, [&visit, sub = subkey{ki, ke}](value_ptr val)
+            {
+                visit(val, sub);
+            });
+        }
+
+        void visit_within(ast::context const& new_ctx, ast::content_list const& contents)
+        {
+            auto const old_ctx = ctx;
+            ctx = &new_ctx;
+            for (auto const content : contents)
+                new_ctx.visit(*this, content);
+            ctx = old_ctx;
+        }
+
+        void visit_within(ast::document const& doc)
+        {
+            visit_within(doc.ctx, doc.contents);
+        }
+
+        void visit_within(ast::program const& new_prog, ast::instruction const* pc)
+        {
+            auto const old_prog = prog;
+            prog = &new_prog;
+            run(pc);
+            prog = old_prog;
+        }
+
+        void visit_within(format const& fmt)
+        {
+            auto const old_keys = lookups.bind(lookup_cache::keys_of(fmt));
+            if (auto const p = fmt.program())
+                visit_within(*p, p->code());
+            else
+                visit_within(fmt.doc());
+            lookups.bind(old_keys);
+        }
+
+        // The lazy formats.
+        void visit_temp(format const& fmt)
+        {
+            chain.enter_temp();
+            visit_within(fmt);
+            chain.leave_temp();
+        }
+
+        template<class Sink>
+        void print_value(Sink const& os, value_ptr val, spec_ref spec, bool interpolation);
+
+        void handle_variable(ast::type tag, value_ptr val, spec_ref spec);
+
+        void expand(ast::content_list const& contents)
+        {
+            for (auto const content : contents)
+                ctx->visit(*this, content);
+        }
+
+        void expand(ast::instruction const* pc)
+        {
+            run(pc);
+        }
+
+        void run(ast::instruction const* pc);
+
+        // The contents of the block, for the lambdas.
+        ast::view view_of(ast::content_list const& contents) const
+        {
+            return {*ctx, contents};
+        }
+
+        // The program is rebuilt into a document for that, once.
+        ast::view view_of(ast::instruction const* body) const
+        {
+            auto const& doc = prog->doc();
+            return {doc.ctx, doc.ctx.blocks[body[-1].aux].contents};
+        }
+
+        segment_range<ast::segment> path_of(unsigned path, unsigned path_size) const
+        {
+            auto const i = ctx->keys.data() + path;
+            return {i, i + path_size, nullptr};
+        }
+
+        segment_range<ast::packed_segment> path_of(ast::instruction const& node) const
+        {
+            auto const i = prog->keys().data() + node.first;
+            return {i, i + node.count, prog->pool()};
+        }
+
+        // `Body` is either the `ast::content_list` or the compiled one.
+        template<class Body>
+        void expand_on_object(Body const& contents, value_ptr val)
+        {
+            auto const old_cursor = cursor;
+            auto const data = object_ptr::of(val);
+            content_scope curr{scope, data};
+            cursor = val;
+            scope = &curr;
+            expand(contents);
+            scope = curr.parent;
+            cursor = old_cursor;
+        }
+
+        template<class Body>
+        void expand_on_value(Body const& contents, value_ptr val)
+        {
+            if (val.vptr->kind == model::object)
+                expand_on_object(contents, val);
+            else
+            {
+                cursor = val;
+                expand(contents);
+            }
+        }
+
+        template<class Body>
+        bool expand_section(ast::type tag, Body const& body, value_ptr val);
+
+        template<class Seg, class Body>
+        void handle_block(ast::type tag, std::string_view key, segment_range<Seg> path, Body const& body);
+
+        value_ptr unresolved(std::string_view key) const
+        {
+            if constexpr (std::is_null_pointer_v<Unresolved>)
+                return nullptr;
+            else if constexpr (std::is_constructible_v<bool, Unresolved const&>)
+                return variable_unresolved ? variable_unresolved(std::string(key)) : nullptr;
+            else
+                return variable_unresolved(std::string(key));
+        }
+
+        // For the keys that are only known at render time.
+        void resolve_and_handle(std::string_view key, bool use_unresolved, value_handler handle);
+
+        // For the keys in the AST, with the segments split by `context::add`.
+        template<class Seg>
+        void resolve_and_handle(std::string_view key, segment_range<Seg> path, bool use_unresolved, value_handler handle);
+
+        std::string_view deref_dyn_name(std::string_view key)
+        {
+            if (key.starts_with('*'))
+            {
+                resolve_and_handle(key.substr(1), false, [this](value_ptr val)
+                {
+                    key_cache.clear();
+                    auto const os = [this](char const* data, std::size_t bytes)
+                    {
+                        key_cache.append(data, bytes);
+                    };
+                    print_value(os, val, {}, false);
+                });
+                return key_cache;
+            }
+            return key;
+        }
+
+        format const* find_partial(ast::partial_slot const* slot, std::string_view key)
+        {
+            if (slot)
+                return slot->fmt;
+            auto const name = deref_dyn_name(key);
+            auto const it = partials.find(name);
+            if (it != partials.end())
+                return it->second;
+            auto const fmt = context(std::string(name));
+            partials.emplace(name, fmt);
+            return fmt;
+        }
+
+        void write_indented(std::string_view text, std::span<unsigned const> newlines);
+
+        void handle_text(ast::text const* text)
+        {
+            if (indent.empty())
+                raw_os(text->data(), text->size());
+            else
+                write_indented(*text, ctx->newlines_of(text, lines));
+        }
+
+        void handle_text(ast::instruction const& node)
+        {
+            auto const text = prog->str(node);
+            if (indent.empty())
+                raw_os(text.data(), text.size());
+            else
+                write_indented(text, prog->newlines(node));
+        }
+
+        void resolve_variable(ast::type tag, ast::variable const& variable)
+        {
+            spec_ref spec{};
+            std::string_view key = variable.key;
+            if (auto const split = variable.split)
+            {
+                spec = {variable.spec.get(), key.data() + (split + 1)};
+                key = key.substr(0, split);
+            }
+            resolve_and_handle(key, path_of(variable.path, variable.path_size), true, [=, this](value_ptr val)
+            {
+                handle_variable(tag, val, spec);
+            });
+        }
+
+        void resolve_variable(ast::instruction const& node)
+        {
+            spec_ref spec{};
+            auto key = prog->str(node);
+            if (auto const split = node.aux)
+            {
+                spec = {node.extra ? prog->spec(node.extra - 1).get() : nullptr, key.data() + (split + 1)};
+                key = key.substr(0, split);
+            }
+            resolve_and_handle(key, path_of(node), true, [=, this, tag = node.kind](value_ptr val)
+            {
+                handle_variable(tag, val, spec);
+            });
+        }
+
+        // `overriders` is null if none.
+        void expand_partial(format const& fmt, std::string_view partial_indent, override_context const* overriders);
+
+        void handle_partial(ast::instruction const& node)
+        {
+            auto const key = prog->str(node);
+            if (auto const p = find_partial(node.extra ? prog->slot(node.extra - 1) : nullptr, key))
+            {
+                std::string_view const partial_indent(key.data() + key.size() + 1, node.aux);
+                if (node.arg == 1)
+                    return expand_partial(*p, partial_indent, nullptr);
+                override_context const overriders{nullptr, nullptr, &node, prog};
+                expand_partial(*p, partial_indent, &overriders);
+            }
+        }
+
+        void operator()(ast::type, ast::text const* text)
+        {
+            handle_text(text);
+        }
+
+        void operator()(ast::type tag, ast::variable const* variable)
+        {
+            resolve_variable(tag, *variable);
+        }
+
+        void operator()(ast::type tag, ast::block const* block)
+        {
+            handle_block(tag, block->key, path_of(block->path, block->path_size), block->contents);
+        }
+
+        void operator()(ast::type, ast::partial const* partial)
+        {
+            if (auto const p = find_partial(partial->slot, partial->key))
+            {
+                if (partial->overriders.empty())
+                    return expand_partial(*p, partial->indent, nullptr);
+                override_context const overriders{&partial->overriders, ctx};
+                expand_partial(*p, partial->indent, &overriders);
+            }
+        }
+
+        void operator()(ast::type, void const*) const {} // never called
+    };
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    template<class Sink>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::print_value(Sink const& os, value_ptr val, spec_ref spec, bool interpolation)
+    {
+        switch (val.vptr->kind)
+        {
+        case model::lazy_value:
+            static_cast<lazy_value_vtable const*>(val.vptr)->call(val.data, nullptr, [=, &os, this](value_ptr val)
+            {
+                print_value(os, val, spec, interpolation);
+            });
+            break;
+        case model::lazy_format:
+            if (interpolation)
+            {
+                auto const fmt = static_cast<lazy_format_vtable const*>(val.vptr)->call(val.data, nullptr);
+                visit_temp(fmt);
+            }
+            break;
+        default:
+        {
+            auto const vt = static_cast<value_vtable const*>(val.vptr);
+            if (spec.str)
+                vt->print_spec(val.data, output_handler(os), spec.parsed, spec.str);
+            else if (vt->print_to && vt->max_size <= print_to_size)
+            {
+                // Straight to the sink in one call.
+                char buf[print_to_size];
+                os(buf, vt->print_to(val.data, buf) - buf);
+            }
+            else
+                vt->print(val.data, output_handler(os), nullptr);
+            break;
+        }
+        }
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::handle_variable(ast::type tag, value_ptr val, spec_ref spec)
+    {
+        if (needs_indent)
+        {
+            raw_os(indent.data(), indent.size());
+            needs_indent = false;
+        }
+        if (tag == ast::type::var_raw)
+            print_value(raw_os, val, spec, true);
+        else
+            print_value(escape_os, val, spec, true);
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    template<class Body>
+    bool content_visitor<Os, EscapeOs, Context, Unresolved>::expand_section(ast::type tag, Body const& body, value_ptr val)
+    {
+        bool inverted = false;
+        auto kind = val.vptr->kind;
+        if (kind < model::lazy_value)
+        {
+            switch (tag)
+            {
+            case ast::type::inversion:
+                inverted = true;
+                [[fallthrough]];
+            case ast::type::filter:
+                kind = model::atom;
+                break;
+            case ast::type::loop:
+                kind = model::list;
+                break;
+            default:
+                break;
+            }
+        }
+        else if (tag == ast::type::inversion) // Inverted lazy.
+            return false;
+        switch (kind)
+        {
+        case model::null:
+            return inverted;
+        case model::atom:
+            return static_cast<value_vtable const*>(val.vptr)->test(val.data) ^ inverted;
+        case model::object:
+            expand_on_object(body, val);
+            return false;
+        case model::list:
+        {
+            auto const vt = static_cast<value_vtable const*>(val.vptr);
+            auto const old_cursor = cursor;
+            if (!vt->iterate)
+                expand_on_value(body, val);
+            else
+            {
+                vt->iterate(val.data, [&](value_ptr val)
+                {
+                    expand_on_value(body, val);
+                });
+            }
+            cursor = old_cursor;
+            return false;
+        }
+        case model::lazy_value:
+        {
+            bool ret = false;
+            ast::view const view = view_of(body);
+            static_cast<lazy_value_vtable const*>(val.vptr)->call(val.data, &view, [&](value_ptr val)
+            {
+                ret = expand_section(tag, body, val);
+            });
+            return ret;
+        }
+        case model::lazy_format:
+        {
+            if (tag == ast::type::filter)
+                return true;
+            ast::view const view = view_of(body);
+            auto const fmt = static_cast<lazy_format_vtable const*>(val.vptr)->call(val.data, &view);
+            visit_temp(fmt);
+            return false;
+        }
+        }
+        std::abort(); // Unreachable.
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    template<class Seg, class Body>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::handle_block(ast::type tag, std::string_view key, segment_range<Seg> path, Body const& body)
+    {
+        if (tag == ast::type::inheritance)
+        {
+            auto const result = chain.find(key);
+            if (result.body)
+                visit_within(*result.prog, result.body);
+            else if (result.found)
+                visit_within(*result.ctx, *result.found);
+            else
+                expand(body);
+            return;
+        }
+        ++section_depth;
+        resolve_and_handle(key, path, false, [&](value_ptr val)
+        {
+            if (expand_section(tag, body, val))
+                expand(body);
+        });
+        if (!--section_depth && section_end)
+            section_end();
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::run(ast::instruction const* pc)
+    {
+        // Dispatch on the kind of the instruction, with a jump table if
+        // computed goto is available, so that each dispatch has its own
+        // branch to predict.
+#if defined(__GNUC__)
+        static void* const ops[] =
+        {
+            &&op_null, &&op_text, &&op_variable, &&op_variable,
+            &&op_block, &&op_block, &&op_block, &&op_block, &&op_block,
+            &&op_partial
+        };
+#   define BUSTACHE_OP(label, cases) label
+#   define BUSTACHE_NEXT() goto* ops[static_cast<unsigned>(pc->kind)]
+        BUSTACHE_NEXT();
+#else
+#   define BUSTACHE_OP(label, cases) cases
+#   define BUSTACHE_NEXT() continue
+        for (;;) switch (pc->kind)
+        {
+#endif
+        BUSTACHE_OP(op_null, case ast::type::null):
+            return;
+        BUSTACHE_OP(op_text, case ast::type::text):
+            handle_text(*pc);
+            ++pc;
+            BUSTACHE_NEXT();
+        BUSTACHE_OP(op_variable, case ast::type::var_escaped: case ast::type::var_raw):
+            resolve_variable(*pc);
+            ++pc;
+            BUSTACHE_NEXT();
+        BUSTACHE_OP(op_block, case ast::type::section: case ast::type::inversion: case ast::type::filter: case ast::type::loop: case ast::type::inheritance):
+            handle_block(pc->kind, prog->str(*pc), path_of(*pc), pc + 1);
+            pc += pc->arg;
+            BUSTACHE_NEXT();
+        BUSTACHE_OP(op_partial, case ast::type::partial):
+            handle_partial(*pc);
+            pc += pc->arg;
+            BUSTACHE_NEXT();
+#if !defined(__GNUC__)
+        }
+#endif
+#undef BUSTACHE_NEXT
+#undef BUSTACHE_OP
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::resolve_and_handle(std::string_view key, bool use_unresolved, value_handler handle)
+    {
+        resolve(key, [=, this](value_ptr val, subkey sub)
+        {
+            // The last key tried, i.e. the head if unqualified.
+            std::string_view failed(key.data(), sub.i);
+            if (sub)
+            {
+                if (auto const obj = object_ptr::from_nested(val))
+                {
+                    nested_resolver nested{sub, {}, handle, false};
+                    if (nested.next(obj), nested.done)
+                        return;
+                    failed = nested.last;
+                }
+            }
+            else if (val)
+                return handle(val);
+            handle(use_unresolved ? unresolved(failed) : nullptr);
+        });
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    template<class Seg>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::resolve_and_handle(std::string_view key, segment_range<Seg> path, bool use_unresolved, value_handler handle)
+    {
+        if (path.begin == path.end && key.size() > (key == ".")) [[unlikely]] // Not split.
+            return resolve_and_handle(key, use_unresolved, handle);
+        auto i = path.begin;
+        auto const e = path.end;
+        // Walk the segments from `val`, `i` is left at the one after the last tried.
+        auto const walk = [&](value_ptr val)
+        {
+            if (i == e)
+            {
+                if (!val)
+                    return false;
+                handle(val);
+                return true;
+            }
+            if (auto const obj = object_ptr::from_nested(val))
+            {
+                path_resolver<Seg> nested{i, e, path.pool, lookups, handle, false};
+                nested.next(obj);
+                i = nested.i;
+                return nested.done;
+            }
+            return false;
+        };
+        if (key.starts_with('.'))
+        {
+            if (walk(cursor))
+                return;
+        }
+        else if (i != e)
+        {
+            bool done = false;
+            lookup(scope, key_of(*i++, path.pool, lookups), [&](value_ptr val)
+            {
+                done = walk(val);
+            });
+            if (done)
+                return;
+        }
+        if (!use_unresolved)
+            return handle(nullptr);
+        handle(unresolved(i == path.begin ? key : key_of(i[-1], path.pool, lookups).str));
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::write_indented(std::string_view text, std::span<unsigned const> newlines)
+    {
+        auto const i = text.data();
+        auto const n = text.size();
+        assert(n && "empty text shouldn't be in ast");
+        // The lines are joined with the indent from the newlines recorded
+        // at parse time, and written at once.
+        auto e = newlines.end();
+        // Don't flush indent on last newline.
+        bool const ends_line = i[n - 1] == '\n';
+        e -= ends_line;
+        if (newlines.begin() == e && !needs_indent)
+            raw_os(i, n);
+        else
+        {
+            indented.clear();
+            if (needs_indent)
+                indented += indent;
+            unsigned i0 = 0;
+            for (auto it = newlines.begin(); it != e; ++it)
+            {
+                indented.append(i + i0, *it - i0);
+                indented += indent;
+                i0 = *it;
+            }
+            indented.append(i + i0, n - i0);
+            raw_os(indented.data(), indented.size());
+        }
+        needs_indent = ends_line;
+    }
+
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    void content_visitor<Os, EscapeOs, Context, Unresolved>::expand_partial(format const& fmt, std::string_view partial_indent, override_context const* overriders)
+    {
+        auto const p = fmt.program();
+        if (p ? p->code()->kind == ast::type::null : fmt.doc().contents.empty())
+            return;
+        auto const old_size = indent.size();
+        indent += partial_indent;
+        needs_indent |= !partial_indent.empty();
+        if (!overriders)
+            visit_within(fmt);
+        else
+        {
+            auto const old_chain = chain.push(*overriders);
+            visit_within(fmt);
+            chain.pop(old_chain);
+        }
+        indent.resize(old_size);
+    }
+}
+
+namespace bustache::detail
+{
+    template<class Os, class EscapeOs, class Context, class Unresolved>
+    void render_inline
+    (
+        Os const& raw_os, EscapeOs const& escape_os, format const& fmt, value_ptr data,
+        Context const& context, Unresolved const& f, fn_ptr<void()> section_end
+    )
+    {
+        content_scope scope{nullptr, object_ptr::from(data)};
+        content_visitor<Os, EscapeOs, Context, Unresolved> visitor{scope, data, raw_os, escape_os, context, f, section_end};
+        visitor.visit_within(fmt);
+    }
+
+    // No need to go through `output_handler` when there's no escaping.
+    template<class Sink>
+    inline Sink const& inline_escape_os(Sink const& os, no_escape_t)
+    {
+        return os;
+    }
+
+    template<class Sink, class Escape>
+    inline auto inline_escape_os(Sink const& os, Escape const& escape)
+    {
+        return escape(os);
+    }
+}
+
+namespace bustache
+{
+    // Same as `render`, but the engine is instantiated for the given types,
+    // so the calls to the sink and the handlers can be inlined.
+    // `f` can be `nullptr` if there's no unresolved handler.
+    template<class Sink, class Escape = no_escape_t, class Context = no_context_t, class Unresolved = std::nullptr_t>
+    inline void render_inline
+    (
+        Sink const& os, format const& fmt, value_ref data,
+        Context const& context = {}, Escape escape = {},
+        Unresolved const& f = nullptr
+    )
+    {
+        auto&& escape_os = detail::inline_escape_os(os, escape);
+        detail::render_and_end(os, [&]
+        {
+            if constexpr (requires { os.section_end(); })
+                detail::render_inline(os, escape_os, fmt, data.get_ptr(), context, f, [&os] { os.section_end(); });
+            else
+                detail::render_inline(os, escape_os, fmt, data.get_ptr(), context, f, nullptr);
+        });
+    }
+}
+
+#endif
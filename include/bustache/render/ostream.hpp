@@ -8,7 +8,7 @@
 #define BUSTACHE_RENDER_OSTREAM_HPP_INCLUDED
 
 #include <iostream>
-#include <bustache/render.hpp>
+#include <bustache/render/buffered.hpp>
 
 namespace bustache::detail
 {
@@ -34,7 +34,7 @@ namespace bustache
         Escape escape = {}, unresolved_handler f = nullptr
     )
     {
-        render(detail::ostream_sink<CharT, Traits>{out}, fmt, data, context, escape, f);
+        render(buffered_sink(detail::ostream_sink<CharT, Traits>{out}), fmt, data, context, escape, f);
     }
     
     template<class CharT, class Traits, class... Opts>
@@ -8,7 +8,7 @@
 #define BUSTACHE_RENDER_STRING_HPP_INCLUDED
 
 #include <string>
-#include <bustache/render.hpp>
+#include <bustache/render/buffered.hpp>
 
 namespace bustache::detail
 {
@@ -34,7 +34,7 @@ namespace bustache
         Escape escape = {}, unresolved_handler f = nullptr
     )
     {
-        render(detail::string_sink<String>{out}, fmt, data, context, escape, f);
+        render(buffered_sink(detail::string_sink<String>{out}), fmt, data, context, escape, f);
     }
     
     template<class... Opts>
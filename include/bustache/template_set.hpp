@@ -0,0 +1,102 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_TEMPLATE_SET_HPP_INCLUDED
+#define BUSTACHE_TEMPLATE_SET_HPP_INCLUDED
+
+#include <bustache/model.hpp>
+#include <cstdint>
+#include <deque>
+#include <span>
+
+namespace bustache
+{
+    // Owns the templates by name, and resolves the static partial names in
+    // them to the slots of the set when they're added, so that rendering
+    // does no lookup for them, whatever the context handler is. The slots
+    // are stable, and a name can be referred to before it's added, in which
+    // case it renders nothing until then.
+    //
+    // It's also a context handler, for the dynamic names.
+    //
+    // The formats are owned by the set, and so are the slots that the formats
+    // (and their copies) refer to, so the set must outlive them.
+    class template_set
+    {
+        struct entry
+        {
+            std::string name;
+            std::unique_ptr<format> fmt;
+            ast::partial_slot slot;
+            std::vector<unsigned> partials;
+            std::vector<unsigned> dependents;
+            std::uint64_t version = 0;
+        };
+
+        std::deque<entry> _entries;
+        std::unordered_map<std::string, unsigned, key_hash, std::equal_to<>> _slots;
+
+        BUSTACHE_API unsigned get_slot(std::string_view name);
+
+    public:
+        static constexpr unsigned npos = unsigned(-1);
+
+        template_set() = default;
+        template_set(template_set const&) = delete;
+        template_set& operator=(template_set const&) = delete;
+
+        // Adds or reloads the template, returns its slot.
+        // Reloading bumps the version of it and of its dependents.
+        BUSTACHE_API unsigned add(std::string_view name, format const& fmt);
+
+        // The slot of `name`, or `npos` if it's never been referred to.
+        BUSTACHE_API unsigned find(std::string_view name) const noexcept;
+
+        // Null if not added yet.
+        format const* get(unsigned slot) const noexcept
+        {
+            return _entries[slot].slot.fmt;
+        }
+
+        format const* operator()(std::string const& name) const noexcept
+        {
+            auto const slot = find(name);
+            return slot == npos ? nullptr : get(slot);
+        }
+
+        std::string const& name(unsigned slot) const noexcept
+        {
+            return _entries[slot].name;
+        }
+
+        // The number of slots, including those not added yet.
+        std::size_t size() const noexcept
+        {
+            return _entries.size();
+        }
+
+        // The partials named statically in the template, without duplicates.
+        std::span<unsigned const> partials(unsigned slot) const noexcept
+        {
+            return _entries[slot].partials;
+        }
+
+        // The templates that name the template as a partial.
+        std::span<unsigned const> dependents(unsigned slot) const noexcept
+        {
+            return _entries[slot].dependents;
+        }
+
+        // Changes when the template, or any partial it depends on, directly
+        // or not, is reloaded, e.g. for the caches of `link`.
+        std::uint64_t version(unsigned slot) const noexcept
+        {
+            return _entries[slot].version;
+        }
+    };
+}
+
+#endif
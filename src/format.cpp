@@ -7,8 +7,10 @@
 #include <cassert>
 #include <utility>
 #include <cstring>
+#include <limits>
 #include <exception>
-#include <bustache/format.hpp>
+#include <bustache/model.hpp>
+#include "scan.hpp"
 
 namespace bustache::parser { namespace
 {
@@ -20,124 +22,16 @@ namespace bustache::parser { namespace
         std::string_view close;
     };
 
-    constexpr bool is_space(char c)
-    {
-        switch (c)
-        {
-        case ' ':
-        case '\f':
-        case '\n':
-        case '\r':
-        case '\t':
-        case '\v':
-            return true;
-        }
-        return false;
-    }
-
-#ifdef BUSTACHE_USE_SWAR // Performance tuning, disabled by default.
-    // Use tricks described here:
-    // http://0x80.pl/notesen/2023-03-06-swar-find-any.html
-    // The performance is yet to be explored.
-
-    template<class T>
-    consteval T constv(T value)
-    {
-        return value;
-    }
-
-    constexpr std::uint64_t broadcast(std::uint8_t byte)
-    {
-        return UINT64_C(0x101010101010101) * byte;
-    }
-
-    template<std::uint8_t... c>
-    std::uint64_t clear_ascii(std::uint64_t word)
-    {
-        constexpr auto msb_mask = UINT64_C(0x8080808080808080);
-        constexpr auto mask = ~msb_mask;
-        const auto ascii = word & mask;
-        const auto match = (... & ((ascii ^ constv(broadcast(c))) + mask)) | word;
-        return match & msb_mask;
-    }
-
-    template<std::endian = std::endian::native>
-    constexpr unsigned zero_prefix(std::uint64_t mask);
-
-    template<>
-    constexpr unsigned zero_prefix<std::endian::little>(std::uint64_t mask)
-    {
-        return std::countr_zero(mask) >> 3u;
-    }
-
-    template<>
-    constexpr unsigned zero_prefix<std::endian::big>(std::uint64_t mask)
-    {
-        return std::countl_zero(mask) >> 3u;
-    }
-
-    unsigned space_prefix(std::uint64_t word)
-    {
-        const auto mask = clear_ascii<' ', '\f', '\n', '\r', '\t', '\v'>(word);
-        return zero_prefix(mask);
-    }
-
-#if 0 // This version of 'is_space' is slower.
-    constexpr std::uint64_t has_zero_byte(std::uint64_t v)
-    {
-        return (v - UINT64_C(0x101010101010101)) & ~v &
-            UINT64_C(0x8080808080808080);
-    }
-
-    template<unsigned N>
-    constexpr std::uint64_t chars_mask(const std::uint8_t(&c)[N])
-    {
-        static_assert(N <= 8);
-        std::uint64_t mask = 0;
-        for (unsigned i = 0; i != N; ++i)
-            mask |= std::uint64_t(c[i]) << (8u * i);
-        return mask;
-    }
-
-    constexpr bool is_space(char c)
-    {
-        const auto mask = broadcast(c);
-        constexpr auto chars = chars_mask({' ', '\f', '\n', '\r', '\t', '\v'});
-        return has_zero_byte(mask ^ chars);
-    }
-#endif
-
-    // Return true if it ends.
-    bool skip(I& i, I e) noexcept
-    {
-        auto n = e - i;
-        std::uint64_t word = 0;
-        for (; n >= 8; i += 8, n -= 8) {
-            std::memcpy(&word, i, 8);
-            const auto len = space_prefix(word);
-            if (len != 8) {
-                i += len;
-                return false;
-            }
-        }
-        std::memcpy(&word, i, n);
-        i += space_prefix(word);
-        return i == e;
-    }
-#else
+    using scan::is_space;
 
     // Return true if it ends.
     inline bool skip(I& i, I e) noexcept
     {
-        while (i != e)
-        {
-            if (!is_space(*i))
-                return false;
-            ++i;
-        }
-        return true;
+        // Most of the time there's no space at all, don't bother dispatching.
+        if (i != e && is_space(*i))
+            i = scan::skip_space(i + 1, e);
+        return i == e;
     }
-#endif
 
     inline bool parse_sentinel(I& i, I e, char c) noexcept
     {
@@ -174,7 +68,30 @@ namespace bustache::parser { namespace
         }
     }
 
-    unsigned expect_key(I b, I& i, I e, delim& d, std::string& key, char sentinel)
+    // Return the first brace that isn't matched, or null if none, since no
+    // spec is valid with those.
+    I find_unbalanced(I i, I e) noexcept
+    {
+        I open = nullptr;
+        unsigned depth = 0;
+        for (; i != e; ++i)
+        {
+            if (*i == '{')
+            {
+                if (!depth++)
+                    open = i;
+            }
+            else if (*i == '}')
+            {
+                if (!depth)
+                    return i;
+                --depth;
+            }
+        }
+        return depth ? open : nullptr;
+    }
+
+    unsigned expect_key(I b, I& i, I e, delim& d, std::string& key, char sentinel, std::shared_ptr<ast::format_spec const>* spec = nullptr)
     {
         unsigned split = 0;
         skip(i, e);
@@ -189,6 +106,14 @@ namespace bustache::parser { namespace
                 {
                     if (split ? split + 1 == i1 - i0 : i0 == i1) [[unlikely]]
                         break;
+                    if (split && spec)
+                    {
+                        if (I const p = find_unbalanced(i0 + split + 1, i1)) [[unlikely]]
+                            throw format_error(error_badspec, p - b);
+                        // Those not taken by the arithmetic types are passed
+                        // as is, e.g. for a custom `impl_print`.
+                        *spec = detail::parse_spec(std::string_view(i0 + split + 1, i1 - i0 - split - 1));
+                    }
                     key.append(i0, i1);
                     return split;
                 }
@@ -316,10 +241,14 @@ namespace bustache::parser { namespace
 
     void expect_comment(I b, I& i, I e, delim& d)
     {
-        while (!parse_lit(i, e, d.close))
+        auto const c = d.close.front();
+        for (;;)
         {
+            i = scan::find_byte(i, e, c);
             if (i == e)
                 throw format_error(error_delim, i - b);
+            if (parse_lit(i, e, d.close))
+                return;
             ++i;
         }
     }
@@ -434,7 +363,7 @@ namespace bustache::parser { namespace
         {
             ast::variable a;
             char const sentinel = *i == '{' ? '}' : '\0';
-            a.split = expect_key(b, ++i, e, d, a.key, sentinel);
+            a.split = expect_key(b, ++i, e, d, a.key, sentinel, &a.spec);
             attr = ctx.add(ast::type::var_raw, std::move(a));
             pure = false;
             break;
@@ -450,7 +379,7 @@ namespace bustache::parser { namespace
         }
         default:
             ast::variable a;
-            a.split = expect_key(b, i, e, d, a.key, '\0');
+            a.split = expect_key(b, i, e, d, a.key, '\0', &a.spec);
             attr = ctx.add(ast::type::var_escaped, std::move(a));
             pure = false;
             break;
@@ -519,8 +448,10 @@ namespace bustache::parser { namespace
                 }
                 else
                 {
+                    // Once the line is known to be impure, nothing matters
+                    // until the next newline or delimiter.
                     pure = false;
-                    ++i;
+                    i = scan::find_either(i + 1, e, '\n', d.open.front());
                 }
             }
         }
@@ -565,6 +496,8 @@ namespace bustache
             return "mismatched end section tag";
         case error_badkey:
             return "invalid key";
+        case error_badspec:
+            return "invalid format spec";
         default:
             assert(!"should not happen");
             std::terminate();
@@ -580,6 +513,247 @@ namespace bustache
         parser::parser{_doc.ctx}.parse_start(begin, end, _doc.contents);
     }
 
+    namespace
+    {
+        // Lays out the nodes as `ast::program`, into the tables to be copied
+        // into its allocation.
+        struct compiler
+        {
+            ast::context const& ctx;
+            std::vector<ast::instruction> code = {};
+            std::vector<unsigned> newlines = {};
+            std::vector<ast::partial_slot const*> slots = {};
+            std::vector<std::shared_ptr<ast::format_spec const>> specs = {};
+            std::string pool = {};
+            std::vector<unsigned> lines = {}; // Of the texts not recorded.
+            unsigned blocks = 0;
+
+            unsigned add_str(std::string_view str)
+            {
+                auto const ret = unsigned(pool.size());
+                pool += str;
+                return ret;
+            }
+
+            unsigned add_key(std::string_view key)
+            {
+                auto const ret = add_str(key);
+                pool += '\0';
+                return ret;
+            }
+
+            void operator()(ast::type kind, ast::text const* node)
+            {
+                auto const lines_of = ctx.newlines_of(node, lines);
+                code.push_back
+                ({
+                    kind, 0, add_str(*node), unsigned(node->size()),
+                    unsigned(newlines.size()), unsigned(lines_of.size()), 0, 0
+                });
+                newlines.insert(newlines.end(), lines_of.begin(), lines_of.end());
+            }
+
+            void operator()(ast::type kind, ast::variable const* node)
+            {
+                unsigned spec = 0;
+                if (node->spec)
+                {
+                    specs.push_back(node->spec);
+                    spec = unsigned(specs.size());
+                }
+                code.push_back
+                ({
+                    kind, 0, add_key(node->key), unsigned(node->key.size()),
+                    node->path, node->path_size, node->split, spec
+                });
+            }
+
+            void operator()(ast::type kind, ast::block const* node)
+            {
+                auto const i = code.size();
+                code.push_back
+                ({
+                    kind, 0, add_key(node->key), unsigned(node->key.size()),
+                    node->path, node->path_size, blocks++, 0
+                });
+                compile(node->contents);
+                code[i].arg = unsigned(code.size() - i);
+            }
+
+            void operator()(ast::type kind, ast::partial const* node)
+            {
+                auto const i = code.size();
+                unsigned slot = 0;
+                if (node->slot)
+                {
+                    slots.push_back(node->slot);
+                    slot = unsigned(slots.size());
+                }
+                auto const key = add_key(node->key);
+                add_str(node->indent);
+                code.push_back
+                ({
+                    kind, 0, key, unsigned(node->key.size()),
+                    0, 0, unsigned(node->indent.size()), slot
+                });
+                for (auto const& [name, contents] : node->overriders)
+                {
+                    auto const j = code.size();
+                    code.push_back({ast::type::inheritance, 0, add_key(name), unsigned(name.size()), 0, 0, 0, 0});
+                    compile(contents);
+                    code[j].arg = unsigned(code.size() - j);
+                }
+                code[i].arg = unsigned(code.size() - i);
+            }
+
+            void operator()(ast::type, void const*) {} // never called
+
+            // Ends with a `null` node.
+            void compile(ast::content_list const& contents)
+            {
+                for (auto const content : contents)
+                {
+                    if (!content.is_null())
+                        ctx.visit(*this, content);
+                }
+                code.push_back({});
+            }
+        };
+
+        // Rebuilds the document from the program, in the order of the nodes,
+        // so that the blocks are at `instruction::aux`.
+        struct decompiler
+        {
+            ast::program const& prog;
+            ast::context& ctx;
+
+            // Returns past the end of the list.
+            ast::instruction const* decompile(ast::instruction const* pc, ast::content_list& out)
+            {
+                for (; pc->kind != ast::type::null; ++pc)
+                {
+                    auto const& node = *pc;
+                    auto const str = prog.str(node);
+                    switch (node.kind)
+                    {
+                    case ast::type::text:
+                    {
+                        out.push_back({node.kind, unsigned(ctx.texts.size())});
+                        ctx.texts.push_back(str);
+                        auto const lines = prog.newlines(node);
+                        ctx.newlines.insert(ctx.newlines.end(), lines.begin(), lines.end());
+                        ctx.newline_ends.push_back(unsigned(ctx.newlines.size()));
+                        break;
+                    }
+                    case ast::type::var_escaped:
+                    case ast::type::var_raw:
+                        out.push_back({node.kind, unsigned(ctx.variables.size())});
+                        ctx.variables.push_back
+                        ({
+                            std::string(str), node.aux,
+                            node.extra ? prog.spec(node.extra - 1) : nullptr,
+                            node.first, node.count
+                        });
+                        break;
+                    case ast::type::partial:
+                    {
+                        ast::partial a
+                        {
+                            std::string(str), std::string(str.data() + str.size() + 1, node.aux), {},
+                            node.extra ? prog.slot(node.extra - 1) : nullptr
+                        };
+                        auto const e = pc + node.arg;
+                        for (++pc; pc != e; pc += pc->arg)
+                            decompile(pc + 1, a.overriders[std::string(prog.str(*pc))]);
+                        out.push_back(ctx.add(std::move(a)));
+                        --pc;
+                        break;
+                    }
+                    default:
+                    {
+                        auto const index = ctx.blocks.size();
+                        assert(index == node.aux);
+                        ctx.blocks.push_back({std::string(str), {}, node.first, node.count});
+                        ast::content_list contents;
+                        pc = decompile(pc + 1, contents) - 1;
+                        ctx.blocks[index].contents = std::move(contents);
+                        out.push_back({node.kind, unsigned(index)});
+                        break;
+                    }
+                    }
+                }
+                return pc + 1;
+            }
+        };
+    }
+
+    ast::program::program(document const& doc)
+    {
+        compiler c{doc.ctx};
+        c.compile(doc.contents);
+        // The chars of the segments follow those of the nodes.
+        std::vector<packed_segment> keys;
+        keys.reserve(doc.ctx.keys.size());
+        for (auto const& seg : doc.ctx.keys)
+            keys.push_back({c.add_str(seg.str), unsigned(seg.str.size()), seg.hash});
+
+        // Each table is aligned as the next one.
+        _layout.key_count = keys.size();
+        _layout.slots = keys.size() * sizeof(packed_segment);
+        _layout.code = _layout.slots + c.slots.size() * sizeof(partial_slot const*);
+        _layout.newlines = _layout.code + c.code.size() * sizeof(instruction);
+        _layout.pool = _layout.newlines + c.newlines.size() * sizeof(unsigned);
+        _layout.size = _layout.pool + c.pool.size();
+        _data.reset(new std::byte[_layout.size]);
+        auto const copy = [this](std::size_t offset, auto const& table)
+        {
+            if (!table.empty())
+                std::memcpy(_data.get() + offset, table.data(), table.size() * sizeof(table[0]));
+        };
+        copy(0, keys);
+        copy(_layout.slots, c.slots);
+        copy(_layout.code, c.code);
+        copy(_layout.newlines, c.newlines);
+        copy(_layout.pool, c.pool);
+        _specs = std::move(c.specs);
+    }
+
+    ast::document ast::program::to_document() const
+    {
+        document ret;
+        auto& keys = ret.ctx.keys;
+        keys.reserve(_layout.key_count);
+        for (auto const& seg : this->keys())
+        {
+            auto& k = keys.emplace_back();
+            k.str.assign(pool() + seg.str, seg.size);
+            k.hash = seg.hash;
+        }
+        decompiler{*this, ret.ctx}.decompile(code(), ret.contents);
+        return ret;
+    }
+
+    ast::document const& ast::program::doc() const
+    {
+        if (auto const p = _doc.load(std::memory_order_acquire))
+            return *p;
+        auto desired = std::make_unique<document const>(to_document());
+        document const* expected = nullptr;
+        // Another thread may have done it first.
+        if (_doc.compare_exchange_strong(expected, desired.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+            return *desired.release();
+        return *expected;
+    }
+
+    void format::compile()
+    {
+        if (_code)
+            return;
+        _code = ast::program(_doc);
+        _doc = {};
+        _text.reset();
+    }
+
     std::size_t format::text_size() const noexcept
     {
         std::size_t n = 0;
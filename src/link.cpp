@@ -0,0 +1,266 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <bustache/link.hpp>
+#include <algorithm>
+#include <deque>
+
+namespace bustache { namespace
+{
+    // Whether the next output starts a line, which takes the indent, as
+    // `needs_indent` in the renderer.
+    enum class line_start
+    {
+        no,
+        yes,
+        unknown
+    };
+
+    line_start join(line_start a, line_start b) noexcept
+    {
+        return a == b ? a : line_start::unknown;
+    }
+
+    // Copies the nodes into a new context, with the partials spliced.
+    // The copies return false if the indent can't be applied ahead, and the
+    // caller rolls back and leaves the partial to be looked up at render time.
+    struct linker
+    {
+        struct overriders
+        {
+            ast::override_map const* map;
+            ast::context const* ctx;
+        };
+
+        context_handler context;
+        ast::context& ctx;
+        std::deque<std::string> texts = {}; // The indented ones.
+        std::vector<format const*> partials = {}; // Being spliced.
+        std::vector<overriders> chain = {}; // Of the parents being spliced.
+        std::string indent = {};
+        line_start start = line_start::no;
+
+        struct mark
+        {
+            std::size_t texts, variables, blocks, partials, keys, newlines;
+        };
+
+        mark get_mark() const noexcept
+        {
+            return
+            {
+                ctx.texts.size(), ctx.variables.size(), ctx.blocks.size(),
+                ctx.partials.size(), ctx.keys.size(), ctx.newlines.size()
+            };
+        }
+
+        void rollback(mark const& m)
+        {
+            ctx.texts.resize(m.texts);
+            ctx.newline_ends.resize(m.texts);
+            ctx.variables.resize(m.variables);
+            ctx.blocks.resize(m.blocks);
+            ctx.partials.resize(m.partials);
+            ctx.keys.resize(m.keys);
+            ctx.newlines.resize(m.newlines);
+        }
+
+        void add_indent(ast::content_list& out)
+        {
+            out.push_back(ctx.add(ast::text(texts.emplace_back(indent))));
+        }
+
+        bool copy(ast::context const& src, ast::content_list const& contents, ast::content_list& out)
+        {
+            bool ok = true;
+            for (auto const content : contents)
+            {
+                src.visit([&](ast::type kind, auto const* node)
+                {
+                    ok = copy(src, kind, node, out);
+                }, content);
+                if (!ok)
+                    break;
+            }
+            return ok;
+        }
+
+        bool copy(ast::context const&, ast::type, ast::text const* node, ast::content_list& out)
+        {
+            auto const ends_line = node->back() == '\n';
+            if (indent.empty())
+                out.push_back(ctx.add(*node));
+            else
+            {
+                if (start == line_start::unknown)
+                    return false;
+                // As `content_visitor::handle_text`.
+                auto& str = texts.emplace_back();
+                if (start == line_start::yes)
+                    str += indent;
+                auto const e = node->end() - ends_line;
+                for (auto i = node->begin(); i != node->end();)
+                {
+                    auto const i0 = i;
+                    i = std::find(i, e, '\n');
+                    if (i != e)
+                    {
+                        str.append(i0, ++i);
+                        str += indent;
+                    }
+                    else
+                    {
+                        str.append(i0, node->end());
+                        break;
+                    }
+                }
+                out.push_back(ctx.add(ast::text(str)));
+            }
+            start = ends_line ? line_start::yes : line_start::no;
+            return true;
+        }
+
+        bool copy(ast::context const&, ast::type kind, ast::variable const* node, ast::content_list& out)
+        {
+            if (!indent.empty())
+            {
+                if (start == line_start::unknown)
+                    return false;
+                if (start == line_start::yes)
+                    add_indent(out);
+            }
+            ast::variable a{node->key, node->split, node->spec};
+            out.push_back(ctx.add(kind, std::move(a)));
+            start = line_start::no;
+            return true;
+        }
+
+        bool copy(ast::context const& src, ast::type kind, ast::block const* node, ast::content_list& out)
+        {
+            if (kind == ast::type::inheritance)
+            {
+                // The overriding content is only known at render time.
+                if (!indent.empty())
+                    return false;
+                // The outermost overrider wins. The block is kept, with the
+                // overriding content, so that the overriders of the linked
+                // format, if used as a parent, still win.
+                for (auto const& [map, map_ctx] : chain)
+                {
+                    auto const it = map->find(node->key);
+                    if (it != map->end())
+                    {
+                        ast::block a{node->key, {}};
+                        if (!copy(*map_ctx, it->second, a.contents))
+                            return false;
+                        out.push_back(ctx.add(kind, std::move(a)));
+                        return true;
+                    }
+                }
+            }
+            ast::block a{node->key, {}};
+            auto const entry = start;
+            auto const m = get_mark();
+            if (!copy(src, node->contents, a.contents))
+                return false;
+            // Rendered 0 or more times, or once for the inheritance.
+            if (kind != ast::type::inheritance && start != entry)
+            {
+                // The next rounds don't start the same way, copy it again
+                // as unknown, which is fine if it doesn't matter.
+                if (kind != ast::type::inversion && !indent.empty())
+                {
+                    rollback(m);
+                    a.contents.clear();
+                    start = line_start::unknown;
+                    if (!copy(src, node->contents, a.contents))
+                        return false;
+                }
+                start = join(start, entry);
+            }
+            out.push_back(ctx.add(kind, std::move(a)));
+            return true;
+        }
+
+        bool copy(ast::context const& src, ast::type, ast::partial const* node, ast::content_list& out)
+        {
+            if (splice(src, *node, out))
+                return true;
+            // The indent of the enclosing partials would be lost, as would
+            // the overriders of the enclosing parents.
+            if (!indent.empty() || !chain.empty())
+                return false;
+            ast::partial a{node->key, node->indent, {}, node->slot};
+            for (auto const& [key, contents] : node->overriders)
+            {
+                auto& overrider = a.overriders[key];
+                if (!copy(src, contents, overrider))
+                    return false;
+            }
+            out.push_back(ctx.add(std::move(a)));
+            // As the inheritance blocks, what's in it is only known at render time.
+            start = line_start::unknown;
+            return true;
+        }
+
+        bool copy(ast::context const&, ast::type, void const*, ast::content_list&)
+        {
+            return true;
+        }
+
+        bool splice(ast::context const& src, ast::partial const& node, ast::content_list& out)
+        {
+            if (node.key.starts_with('*'))
+                return false;
+            bool const parent = !node.overriders.empty();
+            if (parent && !(indent.empty() && node.indent.empty()))
+                return false;
+            auto const fmt = node.slot ? node.slot->fmt : context(node.key);
+            if (!fmt || std::find(partials.begin(), partials.end(), fmt) != partials.end())
+                return false;
+            auto const& doc = fmt->doc();
+            if (doc.contents.empty())
+                return true;
+            auto const m = get_mark();
+            auto const old_size = out.size();
+            auto const old_start = start;
+            auto const old_indent = indent.size();
+            indent += node.indent;
+            if (!node.indent.empty())
+                start = line_start::yes;
+            partials.push_back(fmt);
+            if (parent)
+                chain.push_back({&node.overriders, &src});
+            bool const ok = copy(doc.ctx, doc.contents, out);
+            if (parent)
+                chain.pop_back();
+            partials.pop_back();
+            indent.resize(old_indent);
+            if (!ok)
+            {
+                rollback(m);
+                out.resize(old_size);
+                start = old_start;
+            }
+            return ok;
+        }
+    };
+}}
+
+namespace bustache
+{
+    format link(format const& fmt, context_handler context)
+    {
+        auto const& doc = fmt.doc();
+        ast::document linked;
+        linker l{context, linked.ctx};
+        l.copy(doc.ctx, doc.contents, linked.contents);
+        format ret(std::move(linked), true);
+        if (fmt.compiled() && !ret.compiled())
+            ret.compile();
+        return ret;
+    }
+}
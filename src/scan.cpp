@@ -0,0 +1,420 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BUSTACHE_SCAN_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define BUSTACHE_TARGET(arch)
+#else
+#define BUSTACHE_TARGET(arch) __attribute__((target(arch)))
+#endif
+#endif
+
+#if (defined(BUSTACHE_SCAN_FORCE_SSE42) || defined(BUSTACHE_SCAN_FORCE_AVX2)) && !defined(BUSTACHE_SCAN_X86)
+#error "BUSTACHE_SCAN: the forced variant is not available on this target"
+#endif
+
+namespace bustache::scan { namespace
+{
+    namespace scalar
+    {
+        I skip_space(I i, I e) noexcept
+        {
+            while (i != e && is_space(*i))
+                ++i;
+            return i;
+        }
+
+        I find_byte(I i, I e, char c) noexcept
+        {
+            while (i != e && *i != c)
+                ++i;
+            return i;
+        }
+
+        I find_either(I i, I e, char a, char b) noexcept
+        {
+            while (i != e && *i != a && *i != b)
+                ++i;
+            return i;
+        }
+
+        I find_in_set(I i, I e, byte_set set) noexcept
+        {
+            while (i != e && !in_set(set, *i))
+                ++i;
+            return i;
+        }
+
+        constexpr kernels table{"scalar", skip_space, find_byte, find_either, find_in_set};
+    }
+
+    // Use tricks described here:
+    // http://0x80.pl/notesen/2023-03-06-swar-find-any.html
+    namespace swar
+    {
+        using word_t = std::uint64_t;
+
+        constexpr word_t msb_mask = UINT64_C(0x8080808080808080);
+
+        constexpr word_t broadcast(std::uint8_t byte)
+        {
+            return UINT64_C(0x101010101010101) * byte;
+        }
+
+        inline word_t load(I i) noexcept
+        {
+            word_t word;
+            std::memcpy(&word, i, sizeof(word));
+            return word;
+        }
+
+        // Set the MSB of each byte that is zero, exactly.
+        constexpr word_t zero_bytes(word_t word)
+        {
+            constexpr auto mask = ~msb_mask;
+            return ~(((word & mask) + mask) | word) & msb_mask;
+        }
+
+        // Set the MSB of each byte that isn't any of `c`.
+        template<std::uint8_t... c>
+        constexpr word_t clear_ascii(word_t word)
+        {
+            constexpr auto mask = ~msb_mask;
+            const auto ascii = word & mask;
+            const auto match = (... & ((ascii ^ broadcast(c)) + mask)) | word;
+            return match & msb_mask;
+        }
+
+        // Number of bytes (in memory order) before the first marked one.
+        template<std::endian = std::endian::native>
+        constexpr unsigned zero_prefix(word_t mask);
+
+        template<>
+        constexpr unsigned zero_prefix<std::endian::little>(word_t mask)
+        {
+            return std::countr_zero(mask) >> 3u;
+        }
+
+        template<>
+        constexpr unsigned zero_prefix<std::endian::big>(word_t mask)
+        {
+            return std::countl_zero(mask) >> 3u;
+        }
+
+        I skip_space(I i, I e) noexcept
+        {
+            for (; e - i >= 8; i += 8)
+            {
+                const auto mask = clear_ascii<' ', '\f', '\n', '\r', '\t', '\v'>(load(i));
+                if (mask)
+                    return i + zero_prefix(mask);
+            }
+            return scalar::skip_space(i, e);
+        }
+
+        I find_byte(I i, I e, char c) noexcept
+        {
+            const auto vc = broadcast(std::uint8_t(c));
+            for (; e - i >= 8; i += 8)
+            {
+                if (const auto mask = zero_bytes(load(i) ^ vc))
+                    return i + zero_prefix(mask);
+            }
+            return scalar::find_byte(i, e, c);
+        }
+
+        I find_either(I i, I e, char a, char b) noexcept
+        {
+            const auto va = broadcast(std::uint8_t(a));
+            const auto vb = broadcast(std::uint8_t(b));
+            for (; e - i >= 8; i += 8)
+            {
+                const auto word = load(i);
+                if (const auto mask = zero_bytes(word ^ va) | zero_bytes(word ^ vb))
+                    return i + zero_prefix(mask);
+            }
+            return scalar::find_either(i, e, a, b);
+        }
+
+        // No good way to do table lookup in SWAR, so this uses the scalar one.
+        constexpr kernels table{"swar", skip_space, find_byte, find_either, scalar::find_in_set};
+    }
+
+#ifdef BUSTACHE_SCAN_X86
+    namespace sse42
+    {
+        BUSTACHE_TARGET("sse4.2")
+        I skip_space(I i, I e) noexcept
+        {
+            auto const set = _mm_setr_epi8(' ', '\f', '\n', '\r', '\t', '\v', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+            for (; e - i >= 16; i += 16)
+            {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(i));
+                auto const n = _mm_cmpestri(set, 6, v, 16,
+                    _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_NEGATIVE_POLARITY);
+                if (n != 16)
+                    return i + n;
+            }
+            return scalar::skip_space(i, e);
+        }
+
+        BUSTACHE_TARGET("sse4.2")
+        I find_byte(I i, I e, char c) noexcept
+        {
+            auto const vc = _mm_set1_epi8(c);
+            for (; e - i >= 16; i += 16)
+            {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(i));
+                if (auto const mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(v, vc))))
+                    return i + std::countr_zero(mask);
+            }
+            return scalar::find_byte(i, e, c);
+        }
+
+        BUSTACHE_TARGET("sse4.2")
+        I find_either(I i, I e, char a, char b) noexcept
+        {
+            auto const va = _mm_set1_epi8(a);
+            auto const vb = _mm_set1_epi8(b);
+            for (; e - i >= 16; i += 16)
+            {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(i));
+                auto const m = _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb));
+                if (auto const mask = unsigned(_mm_movemask_epi8(m)))
+                    return i + std::countr_zero(mask);
+            }
+            return scalar::find_either(i, e, a, b);
+        }
+
+        // Classify the bytes by looking up their nibbles in `set`.
+        BUSTACHE_TARGET("sse4.2")
+        I find_in_set(I i, I e, byte_set set) noexcept
+        {
+            auto const lower = _mm_loadu_si128(reinterpret_cast<__m128i const*>(set));
+            auto const upper = _mm_loadu_si128(reinterpret_cast<__m128i const*>(set + 16));
+            auto const bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+            auto const nibble = _mm_set1_epi8(0x0f);
+            auto const zero = _mm_setzero_si128();
+            for (; e - i >= 16; i += 16)
+            {
+                auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(i));
+                auto const lo = _mm_and_si128(v, nibble);
+                auto const hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+                // The MSB of `v` tells which table to use.
+                auto const row = _mm_blendv_epi8(_mm_shuffle_epi8(lower, lo), _mm_shuffle_epi8(upper, lo), v);
+                auto const hit = _mm_and_si128(row, _mm_shuffle_epi8(bits, hi));
+                if (auto const mask = ~unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(hit, zero))) & 0xffffu)
+                    return i + std::countr_zero(mask);
+            }
+            return scalar::find_in_set(i, e, set);
+        }
+
+        constexpr kernels table{"sse4.2", skip_space, find_byte, find_either, find_in_set};
+    }
+
+    // Note that the tails are handed to the SSE versions, which are not
+    // VEX-encoded, so the upper halves must be cleared before that to avoid
+    // the transition penalty.
+    namespace avx2
+    {
+        BUSTACHE_TARGET("avx2")
+        I skip_space(I i, I e) noexcept
+        {
+            // Spaces are ' ' and ['\t', '\r'].
+            auto const sp = _mm256_set1_epi8(' ');
+            auto const lo = _mm256_set1_epi8('\t');
+            auto const n = _mm256_set1_epi8('\r' - '\t');
+            for (; e - i >= 32; i += 32)
+            {
+                auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(i));
+                auto const d = _mm256_sub_epi8(v, lo);
+                auto const ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(d, n), d);
+                auto const m = _mm256_or_si256(_mm256_cmpeq_epi8(v, sp), ctl);
+                if (auto const mask = ~unsigned(_mm256_movemask_epi8(m)))
+                    return i + std::countr_zero(mask);
+            }
+            _mm256_zeroupper();
+            return scalar::skip_space(i, e);
+        }
+
+        BUSTACHE_TARGET("avx2")
+        I find_byte(I i, I e, char c) noexcept
+        {
+            auto const vc = _mm256_set1_epi8(c);
+            for (; e - i >= 32; i += 32)
+            {
+                auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(i));
+                if (auto const mask = unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vc))))
+                    return i + std::countr_zero(mask);
+            }
+            _mm256_zeroupper();
+            return sse42::find_byte(i, e, c);
+        }
+
+        BUSTACHE_TARGET("avx2")
+        I find_either(I i, I e, char a, char b) noexcept
+        {
+            auto const va = _mm256_set1_epi8(a);
+            auto const vb = _mm256_set1_epi8(b);
+            for (; e - i >= 32; i += 32)
+            {
+                auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(i));
+                auto const m = _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb));
+                if (auto const mask = unsigned(_mm256_movemask_epi8(m)))
+                    return i + std::countr_zero(mask);
+            }
+            _mm256_zeroupper();
+            return sse42::find_either(i, e, a, b);
+        }
+
+        BUSTACHE_TARGET("avx2")
+        I find_in_set(I i, I e, byte_set set) noexcept
+        {
+            auto const lower = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(set)));
+            auto const upper = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(set + 16)));
+            auto const bits = _mm256_setr_epi8(
+                1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+            auto const nibble = _mm256_set1_epi8(0x0f);
+            auto const zero = _mm256_setzero_si256();
+            for (; e - i >= 32; i += 32)
+            {
+                auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(i));
+                auto const lo = _mm256_and_si256(v, nibble);
+                auto const hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+                auto const row = _mm256_blendv_epi8(_mm256_shuffle_epi8(lower, lo), _mm256_shuffle_epi8(upper, lo), v);
+                auto const hit = _mm256_and_si256(row, _mm256_shuffle_epi8(bits, hi));
+                if (auto const mask = ~unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hit, zero))))
+                    return i + std::countr_zero(mask);
+            }
+            _mm256_zeroupper();
+            return sse42::find_in_set(i, e, set);
+        }
+
+        constexpr kernels table{"avx2", skip_space, find_byte, find_either, find_in_set};
+    }
+
+    struct cpu_features
+    {
+        bool sse42;
+        bool avx2;
+    };
+
+    cpu_features detect() noexcept
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        auto const max_leaf = info[0];
+        __cpuid(info, 1);
+        cpu_features ret{};
+        ret.sse42 = info[2] & (1 << 20);
+        bool const osxsave = info[2] & (1 << 27);
+        bool const avx = info[2] & (1 << 28);
+        if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+        {
+            __cpuidex(info, 7, 0);
+            ret.avx2 = info[1] & (1 << 5);
+        }
+        return ret;
+#else
+        __builtin_cpu_init();
+        return {!!__builtin_cpu_supports("sse4.2"), !!__builtin_cpu_supports("avx2")};
+#endif
+    }
+#endif
+
+    kernels const& select() noexcept
+    {
+#if defined(BUSTACHE_SCAN_FORCE_SCALAR)
+        return scalar::table;
+#elif defined(BUSTACHE_SCAN_FORCE_SWAR)
+        return swar::table;
+#elif defined(BUSTACHE_SCAN_FORCE_SSE42)
+        return sse42::table;
+#elif defined(BUSTACHE_SCAN_FORCE_AVX2)
+        return avx2::table;
+#elif defined(BUSTACHE_SCAN_X86)
+        auto const cpu = detect();
+        if (cpu.avx2)
+            return avx2::table;
+        if (cpu.sse42)
+            return sse42::table;
+        return swar::table;
+#else
+        return swar::table;
+#endif
+    }
+}}
+
+namespace bustache::scan
+{
+    namespace
+    {
+        kernels const& resolve() noexcept
+        {
+            auto const& k = select();
+            current.store(&k, std::memory_order_relaxed);
+            return k;
+        }
+
+        namespace trampoline
+        {
+            I skip_space(I i, I e) noexcept
+            {
+                return resolve().skip_space(i, e);
+            }
+
+            I find_byte(I i, I e, char c) noexcept
+            {
+                return resolve().find_byte(i, e, c);
+            }
+
+            I find_either(I i, I e, char a, char b) noexcept
+            {
+                return resolve().find_either(i, e, a, b);
+            }
+
+            I find_in_set(I i, I e, byte_set set) noexcept
+            {
+                return resolve().find_in_set(i, e, set);
+            }
+
+            constexpr kernels table{"unresolved", skip_space, find_byte, find_either, find_in_set};
+        }
+    }
+
+    constinit std::atomic<kernels const*> current{&trampoline::table};
+
+    std::span<kernels const* const> available() noexcept
+    {
+        static auto const list = []
+        {
+            struct
+            {
+                kernels const* tables[4];
+                std::size_t size;
+            } ret{{&scalar::table, &swar::table}, 2};
+#ifdef BUSTACHE_SCAN_X86
+            auto const cpu = detect();
+            if (cpu.sse42)
+                ret.tables[ret.size++] = &sse42::table;
+            if (cpu.avx2)
+                ret.tables[ret.size++] = &avx2::table;
+#endif
+            return ret;
+        }();
+        return {list.tables, list.size};
+    }
+}
@@ -0,0 +1,99 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef BUSTACHE_SCAN_HPP_INCLUDED
+#define BUSTACHE_SCAN_HPP_INCLUDED
+
+#include <bustache/format.hpp>
+#include <atomic>
+#include <cstdint>
+#include <span>
+
+namespace bustache::scan
+{
+    using I = char const*;
+
+    constexpr bool is_space(char c)
+    {
+        switch (c)
+        {
+        case ' ':
+        case '\f':
+        case '\n':
+        case '\r':
+        case '\t':
+        case '\v':
+            return true;
+        }
+        return false;
+    }
+
+    // A set of bytes as 2 tables indexed by the low nibble, the bits in
+    // `set[lo]` are for high nibbles [0, 8), `set[16 + lo]` for [8, 16).
+    // This is the layout of `detail::byte_set` in render.hpp.
+    using byte_set = std::uint8_t const*;
+
+    constexpr bool in_set(byte_set set, char c)
+    {
+        auto const u = static_cast<unsigned char>(c);
+        return set[(u & 15u) | ((u >> 3) & 16u)] & (1u << ((u >> 4) & 7u));
+    }
+
+    // The byte-scanning kernels, one set per instruction set.
+    // All of them return `e` if nothing is found.
+    struct kernels
+    {
+        char const* name;
+
+        // Find the first byte that is not a space.
+        I(*skip_space)(I i, I e) noexcept;
+
+        // Find the first byte that is `c`.
+        I(*find_byte)(I i, I e, char c) noexcept;
+
+        // Find the first byte that is either `a` or `b`.
+        I(*find_either)(I i, I e, char a, char b) noexcept;
+
+        // Find the first byte that is in `set`.
+        I(*find_in_set)(I i, I e, byte_set set) noexcept;
+    };
+
+    // Points to the kernels picked for this CPU. Initially it points to
+    // a set of trampolines that make the choice on first use.
+    // Can be forced at build time via `BUSTACHE_SCAN`.
+    BUSTACHE_API extern std::atomic<kernels const*> current;
+
+    // All the kernels this CPU supports, the scalar ones first, so that
+    // the tests and the benchmarks can compare them.
+    BUSTACHE_API std::span<kernels const* const> available() noexcept;
+
+    inline kernels const& active() noexcept
+    {
+        return *current.load(std::memory_order_relaxed);
+    }
+
+    inline I skip_space(I i, I e) noexcept
+    {
+        return active().skip_space(i, e);
+    }
+
+    inline I find_byte(I i, I e, char c) noexcept
+    {
+        return active().find_byte(i, e, c);
+    }
+
+    inline I find_either(I i, I e, char a, char b) noexcept
+    {
+        return active().find_either(i, e, a, b);
+    }
+
+    inline I find_in_set(I i, I e, byte_set set) noexcept
+    {
+        return active().find_in_set(i, e, set);
+    }
+}
+
+#endif
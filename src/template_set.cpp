@@ -0,0 +1,77 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <bustache/template_set.hpp>
+#include <algorithm>
+
+namespace bustache
+{
+    unsigned template_set::get_slot(std::string_view name)
+    {
+        auto const it = _slots.find(name);
+        if (it != _slots.end())
+            return it->second;
+        auto const slot = unsigned(_entries.size());
+        _entries.emplace_back().name = name;
+        _slots.emplace(name, slot);
+        return slot;
+    }
+
+    unsigned template_set::find(std::string_view name) const noexcept
+    {
+        auto const it = _slots.find(name);
+        return it == _slots.end() ? npos : it->second;
+    }
+
+    unsigned template_set::add(std::string_view name, format const& fmt)
+    {
+        auto const slot = get_slot(name);
+        // The copy of the document is what's annotated with the slots.
+        ast::document doc(fmt.doc());
+        std::vector<unsigned> partials;
+        for (auto& partial : doc.ctx.partials)
+        {
+            if (partial.key.starts_with('*'))
+                continue;
+            auto const target = get_slot(partial.key);
+            partial.slot = &_entries[target].slot;
+            if (std::find(partials.begin(), partials.end(), target) == partials.end())
+                partials.push_back(target);
+        }
+        auto ptr = std::make_unique<format>(std::move(doc), true);
+        if (fmt.compiled() && !ptr->compiled())
+            ptr->compile();
+
+        auto& e = _entries[slot];
+        for (auto const old : e.partials)
+            std::erase(_entries[old].dependents, slot);
+        for (auto const target : partials)
+            _entries[target].dependents.push_back(slot);
+        e.partials = std::move(partials);
+        e.fmt = std::move(ptr);
+        e.slot.fmt = e.fmt.get();
+
+        // Bump the version of the dependents, directly or not.
+        std::vector<unsigned> stack{slot};
+        std::vector<bool> visited(_entries.size());
+        visited[slot] = true;
+        while (!stack.empty())
+        {
+            auto& cur = _entries[stack.back()];
+            stack.pop_back();
+            ++cur.version;
+            for (auto const dependent : cur.dependents)
+            {
+                if (!visited[dependent])
+                {
+                    visited[dependent] = true;
+                    stack.push_back(dependent);
+                }
+            }
+        }
+        return slot;
+    }
+}
@@ -0,0 +1,130 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/string.hpp>
+#include <bustache/bind.hpp>
+#include <vector>
+
+using namespace bustache;
+
+namespace
+{
+    struct Item
+    {
+        int id;
+        std::string name;
+    };
+
+    struct Page
+    {
+        std::string title;
+        std::vector<Item> items;
+        Item featured;
+    };
+
+    // Counts the keys mapped at render time.
+    inline int lookups = 0;
+}
+
+template<>
+struct bustache::impl_model<Item>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Item>
+{
+    static int slot(std::string_view key)
+    {
+        ++lookups;
+        return key == "id" ? 0 : key == "name" ? 1 : -1;
+    }
+
+    static value_ptr at(Item const& self, int slot)
+    {
+        if (slot == 0)
+            return &self.id;
+        return &self.name;
+    }
+
+    static detail::static_type const* slot_type(int slot)
+    {
+        if (slot == 0)
+            return detail::static_type_of<int>();
+        return detail::static_type_of<std::string>();
+    }
+};
+
+template<>
+struct bustache::impl_model<Page>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Page>
+{
+    static int slot(std::string_view key)
+    {
+        ++lookups;
+        return key == "title" ? 0 : key == "items" ? 1 : key == "featured" ? 2 : -1;
+    }
+
+    static value_ptr at(Page const& self, int slot)
+    {
+        switch (slot)
+        {
+        case 0: return &self.title;
+        case 1: return &self.items;
+        default: return &self.featured;
+        }
+    }
+
+    static detail::static_type const* slot_type(int slot)
+    {
+        switch (slot)
+        {
+        case 0: return detail::static_type_of<std::string>();
+        case 1: return detail::static_type_of<std::vector<Item>>();
+        default: return detail::static_type_of<Item>();
+        }
+    }
+};
+
+TEST_CASE("typed_format")
+{
+    Page const page{"T", {{1, "a"}, {2, "b"}}, {3, "c"}};
+    format const fmt
+    (
+        "{{title}}:{{#items}}{{id}}{{name}}{{title}}{{missing}},{{/items}}"
+        "{{featured.name}}{{featured.nope}}{{#featured}}{{id}}{{/featured}}"
+        "{{title.size}}{{^items}}{{none}}{{/items}}"
+    );
+    typed_format<Page> const typed(fmt);
+
+    CHECK(typed.unresolved() == std::vector<std::string>{"missing", "featured.nope", "title.size", "none"});
+
+    lookups = 0;
+    auto const expected = to_string(fmt(page));
+    CHECK(lookups != 0);
+    lookups = 0;
+    CHECK(to_string(typed(page)) == expected);
+    CHECK(expected == "T:1aT,2bT,c3");
+    CHECK(lookups == 0);
+}
+
+TEST_CASE("typed_format_unknown")
+{
+    // Nothing is known about the values in a map, so nothing is reported.
+    using map = std::unordered_map<std::string, Page>;
+    typed_format<map> const typed(format("{{a.title}}{{#b}}{{id}}{{/b}}"));
+    CHECK(typed.unresolved().empty());
+
+    map const data{{"a", Page{"A", {}, {}}}};
+    CHECK(to_string(typed(data)) == "A");
+}
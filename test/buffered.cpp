@@ -0,0 +1,80 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/buffered.hpp>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+using namespace bustache;
+
+namespace
+{
+    // Record each block forwarded by the buffer.
+    struct record_sink
+    {
+        std::vector<std::string>& blocks;
+
+        void operator()(char const* data, std::size_t bytes) const
+        {
+            blocks.emplace_back(data, bytes);
+        }
+    };
+
+    using map = std::unordered_map<std::string, std::string>;
+}
+
+TEST_CASE("buffered_sink")
+{
+    std::vector<std::string> blocks;
+
+    SECTION("size")
+    {
+        buffered_sink<record_sink, 8> os(record_sink{blocks});
+        os("abc", 3);
+        os("def", 3);
+        CHECK(blocks.empty());
+        CHECK(os.pending() == 6);
+        os("ghi", 3); // Doesn't fit.
+        CHECK(blocks == std::vector<std::string>{"abcdef"});
+        os("0123456789", 10); // Larger than the buffer.
+        CHECK(blocks == std::vector<std::string>{"abcdef", "ghi", "0123456789"});
+        CHECK(os.pending() == 0);
+        os("12345678", 8); // Fits exactly.
+        CHECK(blocks.size() == 3);
+        CHECK(os.pending() == 8);
+        os.flush();
+        CHECK(blocks.back() == "12345678");
+    }
+
+    SECTION("render")
+    {
+        map data{{"a", "A"}, {"b", "B"}};
+        render(buffered_sink(record_sink{blocks}), "{{#a}}{{a}}{{/a}}-{{^c}}{{b}}{{/c}}."_fmt, data);
+        CHECK(blocks == std::vector<std::string>{"A-B."});
+    }
+
+    SECTION("section")
+    {
+        map data{{"a", "A"}, {"b", "B"}};
+        buffered_sink<record_sink, 64, flush_policy::section> os(record_sink{blocks});
+        render(os, "{{#a}}<{{#b}}{{b}}{{/b}}>{{/a}}-{{^c}}{{b}}{{/c}}."_fmt, data);
+        // The nested section doesn't count.
+        CHECK(blocks == std::vector<std::string>{"<B>", "-B", "."});
+    }
+
+    SECTION("manual")
+    {
+        map data{{"a", "A"}};
+        buffered_sink<record_sink, 64, flush_policy::manual> os(record_sink{blocks});
+        render(os, "{{#a}}{{a}}{{/a}}"_fmt, data);
+        render(os, "{{a}}"_fmt, data);
+        CHECK(blocks.empty());
+        os.flush();
+        CHECK(blocks == std::vector<std::string>{"AA"});
+    }
+}
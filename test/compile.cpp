@@ -0,0 +1,86 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/string.hpp>
+#include "model.hpp"
+
+using namespace bustache;
+using namespace test;
+
+namespace
+{
+    format compiled(std::string_view source)
+    {
+        format ret(source);
+        ret.compile();
+        return ret;
+    }
+}
+
+TEST_CASE("compile")
+{
+    object const data
+    {
+        {"title", "<T>"},
+        {"items", array{object{{"name", "x"}, {"on", true}}, object{{"name", "y"}, {"on", false}}}},
+        {"which", "item"}
+    };
+    std::string const source
+    (
+        "{{title}} {{{title}}}\n"
+        "{{#items}}\n"
+        "  {{#on}}[{{name}}]{{/on}}{{^on}}({{name}}){{/on}}\n"
+        "  {{>*which}}\n"
+        "{{/items}}\n"
+        "{{<base}}{{$slot}}override {{title}}{{/slot}}{{/base}}"
+    );
+    context partials
+    {
+        {"item", compiled("<{{name}}>\n")},
+        {"base", compiled("{{$slot}}default{{/slot}}!")}
+    };
+    format fmt(source);
+    auto const expected = to_string(fmt(data).context(partials).escape(escape_html));
+    CHECK(expected == "&lt;T&gt; <T>\n  [x]\n  <x>\n  (y)\n  <y>\noverride &lt;T&gt;!");
+
+    CHECK_FALSE(fmt.compiled());
+    fmt.compile();
+    CHECK(fmt.compiled());
+    CHECK(to_string(fmt(data).context(partials).escape(escape_html)) == expected);
+
+    SECTION("copy")
+    {
+        format const copy(fmt);
+        CHECK(copy.compiled());
+        fmt = format();
+        CHECK(to_string(copy(data).context(partials).escape(escape_html)) == expected);
+    }
+
+    SECTION("texts")
+    {
+        // The program has its own texts.
+        std::string copy(source);
+        format fmt(copy);
+        fmt.compile();
+        copy.assign(copy.size(), '?');
+        CHECK(to_string(fmt(data).context(partials).escape(escape_html)) == expected);
+    }
+
+    SECTION("doc")
+    {
+        // Rebuilt from the program.
+        format const rebuilt(ast::document(fmt.doc()), true);
+        CHECK(to_string(rebuilt(data).context(partials).escape(escape_html)) == expected);
+    }
+
+    SECTION("move")
+    {
+        format const moved(std::move(fmt));
+        CHECK(moved.compiled());
+        CHECK(to_string(moved(data).context(partials).escape(escape_html)) == expected);
+    }
+}
@@ -0,0 +1,145 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+
+#if __has_include(<boost/describe.hpp>)
+#include <boost/describe.hpp>
+#include <bustache/adapted/boost_describe.hpp>
+#include <bustache/render/string.hpp>
+#include <string>
+#include <vector>
+
+using namespace bustache;
+
+namespace
+{
+    struct Base
+    {
+        int id;
+        std::string name;
+    };
+
+    BOOST_DESCRIBE_STRUCT(Base, (), (id, name))
+
+    // `name` hides the one of `Base`.
+    struct Item : Base
+    {
+        std::string name;
+        double price;
+    };
+
+    BOOST_DESCRIBE_STRUCT(Item, (Base), (name, price))
+
+    struct Page
+    {
+        std::string title;
+        std::vector<Item> items;
+    };
+
+    BOOST_DESCRIBE_STRUCT(Page, (), (title, items))
+
+    // Enough members that some share a bucket of the table.
+    struct Wide
+    {
+        int m00, m01, m02, m03, m04, m05, m06, m07, m08, m09;
+        int m10, m11, m12, m13, m14, m15, m16, m17, m18, m19;
+        int m20, m21, m22, m23, m24, m25, m26, m27, m28, m29;
+        int m30, m31, m32, m33, m34, m35, m36, m37, m38, m39;
+    };
+
+    BOOST_DESCRIBE_STRUCT(Wide, (),
+    (
+        m00, m01, m02, m03, m04, m05, m06, m07, m08, m09,
+        m10, m11, m12, m13, m14, m15, m16, m17, m18, m19,
+        m20, m21, m22, m23, m24, m25, m26, m27, m28, m29,
+        m30, m31, m32, m33, m34, m35, m36, m37, m38, m39
+    ))
+
+    hashed_key key(std::string_view str)
+    {
+        return {str, ast::hash_key(str)};
+    }
+
+    template<class T>
+    constexpr bool shares_bucket()
+    {
+        auto const& table = detail::slot_table_of<T>;
+        for (std::size_t i = 0; i != table.names.size(); ++i)
+        {
+            for (std::size_t j = 0; j != i; ++j)
+            {
+                if (table.bucket_of(ast::hash_key(table.names[i])) == table.bucket_of(ast::hash_key(table.names[j])))
+                    return true;
+            }
+        }
+        return false;
+    }
+}
+
+TEST_CASE("describe_render")
+{
+    Item item{};
+    item.id = 7;
+    item.Base::name = "base";
+    item.name = "item";
+    item.price = 1.5;
+    CHECK(to_string("{{id}}-{{name}}-{{price}}-{{nope}}"_fmt(item)) == "7-item-1.5-");
+
+    Page const page{"P", {item, item}};
+    CHECK(to_string("{{title}}:{{#items}}{{name}}{{title}},{{/items}}"_fmt(page)) == "P:itemP,itemP,");
+}
+
+TEST_CASE("describe_slots")
+{
+    using object = impl_object<Item>;
+    // The slots are the members in order, followed by those of the bases,
+    // where the hidden `Base::name` can't be found.
+    CHECK(object::slot(key("name")) == 0);
+    CHECK(object::slot(key("price")) == 1);
+    CHECK(object::slot(key("id")) == 2);
+    CHECK(object::slot(key("")) == -1);
+    CHECK(object::slot(key("names")) == -1);
+
+    static_assert(shares_bucket<Wide>());
+    Wide const wide
+    {
+        100, 101, 102, 103, 104, 105, 106, 107, 108, 109,
+        110, 111, 112, 113, 114, 115, 116, 117, 118, 119,
+        120, 121, 122, 123, 124, 125, 126, 127, 128, 129,
+        130, 131, 132, 133, 134, 135, 136, 137, 138, 139
+    };
+    auto const& table = detail::slot_table_of<Wide>;
+    for (std::size_t i = 0; i != table.names.size(); ++i)
+    {
+        std::string const name(table.names[i]);
+        INFO("name: " << name);
+        CHECK(impl_object<Wide>::slot(key(name)) == int(i));
+        CHECK(to_string(format("{{" + name + "}}")(wide)) == std::to_string(100 + i));
+    }
+    CHECK(impl_object<Wide>::slot(key("m40")) == -1);
+    CHECK(impl_object<Wide>::slot(key("m0")) == -1);
+}
+
+TEST_CASE("describe_typed_format")
+{
+    format const fmt("{{title}}:{{#items}}{{id}}{{name}}{{nope}},{{/items}}");
+    typed_format<Page> const typed(fmt);
+    CHECK(typed.unresolved() == std::vector<std::string>{"nope"});
+
+    Item item{};
+    item.id = 1;
+    item.name = "a";
+    Page const page{"P", {item}};
+    CHECK(to_string(typed(page)) == to_string(fmt(page)));
+    CHECK(to_string(typed(page)) == "P:1a,");
+}
+#else
+TEST_CASE("describe")
+{
+    SUCCEED("Boost.Describe is not available");
+}
+#endif
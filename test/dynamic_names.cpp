@@ -156,4 +156,22 @@ TEST_CASE("dynamic-names") {
     CHECK(to_string("|{{> * dynamic }}|"_fmt(
                         object{{"dynamic", "partial"}, {"boolean", true}})
                         .context(context{{"partial", "[]"_fmt}})) == "|[]|");
-}
\ No newline at end of file
+}
+TEST_CASE("dynamic-names-cached") {
+    context const partials{{"a", "A"_fmt}, {"b", "B{{>*name}}"_fmt}};
+    int lookups = 0;
+    auto const counting = [&](std::string const& key) -> format const* {
+        ++lookups;
+        auto const it = partials.find(key);
+        return it == partials.end() ? nullptr : &it->second;
+    };
+    object const data{
+        {"items", array{object{{"name", "a"}}, object{{"name", "c"}},
+                        object{{"name", "a"}}, object{{"name", "c"}}}},
+        {"name", "a"}};
+
+    // Looked up once per name in a render, including the misses.
+    CHECK(to_string("{{#items}}{{>*name}}{{>b}}{{/items}}"_fmt(data).context(
+              counting)) == "ABABABAB");
+    CHECK(lookups == 3);
+}
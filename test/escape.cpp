@@ -0,0 +1,133 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/string.hpp>
+#include <bustache/escape.hpp>
+#include <unordered_map>
+
+using namespace bustache;
+
+namespace
+{
+    // Escape byte by byte, as a reference.
+    std::string escape_naive(std::string_view str)
+    {
+        std::string ret;
+        for (char c : str)
+        {
+            if (auto const esc = detail::get_escaped(c))
+                ret.append(esc.data, esc.size);
+            else
+                ret.push_back(c);
+        }
+        return ret;
+    }
+
+    template<class Escape = decltype(escape_html)>
+    std::string render_escaped(std::string const& value, Escape escape = escape_html)
+    {
+        std::unordered_map<std::string, std::string> data{{"v", value}};
+        return to_string("{{v}}"_fmt(data).escape(escape));
+    }
+}
+
+TEST_CASE("escape_html")
+{
+    CHECK(render_escaped("") == "");
+    CHECK(render_escaped("plain") == "plain");
+    CHECK(render_escaped("<&>") == "&lt;&amp;&gt;");
+    CHECK(render_escaped("\"a\\b\"") == "&quot;a&#92;b&quot;");
+    // Bytes with the MSB set pass through.
+    CHECK(render_escaped("\xe4\xbd\xa0<\xff") == "\xe4\xbd\xa0&lt;\xff");
+
+    SECTION("long")
+    {
+        // Cross the block boundaries and the staging buffer size.
+        std::string value;
+        for (int i = 0; i != 3000; ++i)
+        {
+            value.push_back(char('a' + i % 26));
+            if (i % 7 == 0)
+                value.push_back("&<>\\\""[i % 5]);
+            if (i % 101 == 0)
+                value.append(600, 'x');
+        }
+        CHECK(render_escaped(value) == escape_naive(value));
+        value.assign(1000, '<');
+        CHECK(render_escaped(value) == escape_naive(value));
+    }
+}
+
+TEST_CASE("escape_json")
+{
+    CHECK(render_escaped("plain", escape_json) == "plain");
+    CHECK(render_escaped("\"a\\b\"", escape_json) == "\\\"a\\\\b\\\"");
+    CHECK(render_escaped("\b\f\n\r\t", escape_json) == "\\b\\f\\n\\r\\t");
+    CHECK(render_escaped(std::string("\0\x1f\x7f/", 4), escape_json) == "\\u0000\\u001f\x7f/");
+    CHECK(render_escaped("<\xe4\xbd\xa0>", escape_json) == "<\xe4\xbd\xa0>");
+}
+
+TEST_CASE("escape_url")
+{
+    CHECK(render_escaped("AZaz09-._~", escape_url) == "AZaz09-._~");
+    CHECK(render_escaped("a b&c=d/e?", escape_url) == "a%20b%26c%3Dd%2Fe%3F");
+    CHECK(render_escaped("\xe4\xbd\xa0", escape_url) == "%E4%BD%A0");
+    CHECK(render_escaped("%", escape_url) == "%25");
+}
+
+TEST_CASE("escape_xml_attr")
+{
+    CHECK(render_escaped("plain", escape_xml_attr) == "plain");
+    CHECK(render_escaped("<a&'\">", escape_xml_attr) == "&lt;a&amp;&apos;&quot;&gt;");
+    CHECK(render_escaped("\t\n\r", escape_xml_attr) == "&#9;&#10;&#13;");
+    CHECK(render_escaped("a\x01" "b", escape_xml_attr) == "a\xef\xbf\xbd" "b");
+}
+
+TEST_CASE("escape_shell")
+{
+    CHECK(render_escaped("a \"$b\" \\c", escape_shell) == "a \"$b\" \\c");
+    CHECK(render_escaped("it's", escape_shell) == "it'\\''s");
+    CHECK(render_escaped("''", escape_shell) == "'\\'''\\''");
+}
+
+TEST_CASE("escape_utf8")
+{
+    auto const html = escape_html.validate_utf8();
+    // Well-formed, up to 4 bytes.
+    CHECK(render_escaped("a\xc2\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80<", html) == "a\xc2\xa9\xe4\xbd\xa0\xf0\x9f\x98\x80&lt;");
+    // Stray continuation, overlong, surrogate, out of range.
+    CHECK(render_escaped("\x80", html) == "\xef\xbf\xbd");
+    CHECK(render_escaped("\xc0\xaf", html) == "\xef\xbf\xbd\xef\xbf\xbd");
+    CHECK(render_escaped("\xed\xa0\x80", html) == "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd");
+    CHECK(render_escaped("\xf4\x90\x80\x80", html) == "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd");
+    CHECK(render_escaped("\xf5", html) == "\xef\xbf\xbd");
+    // Truncated sequences, as one maximal subpart each.
+    CHECK(render_escaped("\xe4\xbd<", html) == "\xef\xbf\xbd&lt;");
+    CHECK(render_escaped("a\xf0\x9f\x98", html) == "a\xef\xbf\xbd");
+    // Runs of well-formed sequences, ended by ill-formed ones.
+    CHECK(render_escaped("\xe4\xbd\xa0\xc2\xa9\xe4\xbd\xa0\x80&", html) == "\xe4\xbd\xa0\xc2\xa9\xe4\xbd\xa0\xef\xbf\xbd&amp;");
+    CHECK(render_escaped("\xc2\xa9\xc2\xa9\xe4\xbd", html) == "\xc2\xa9\xc2\xa9\xef\xbf\xbd");
+    // The replacement goes through the table too.
+    CHECK(render_escaped("\xff", escape_url.validate_utf8()) == "%EF%BF%BD");
+    CHECK(render_escaped("\xe4\xbd\xa0", escape_url.validate_utf8()) == "%E4%BD%A0");
+
+    SECTION("long")
+    {
+        std::string value, expected;
+        for (int i = 0; i != 2000; ++i)
+        {
+            value += "x\xe4\xbd\xa0";
+            expected += "x\xe4\xbd\xa0";
+            if (i % 13 == 0)
+            {
+                value += "\xbd";
+                expected += "\xef\xbf\xbd";
+            }
+        }
+        CHECK(render_escaped(value, escape_json.validate_utf8()) == expected);
+    }
+}
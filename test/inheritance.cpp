@@ -100,4 +100,25 @@ TEST_CASE("inheritance")
     // Text inside super
     CHECK(to_string("{{<include}} asdfasd asdfasdfasdf {{/include}}"_fmt(nullptr)
         .context(context{{"include", "{{$foo}}default content{{/foo}}"_fmt}})) == "default content");
-}
\ No newline at end of file
+}
+
+TEST_CASE("inheritance_cached")
+{
+    context const partials
+    {
+        {"base", "<{{$a}}a0{{/a}}{{$b}}b0{{/b}}>"_fmt},
+        {"mid", "{{<base}}{{$a}}a1{{/a}}{{$b}}b1{{/b}}{{/base}}"_fmt},
+        {"leaf", "({{$c}}c0{{/c}}{{$a}}a0{{/a}})"_fmt}
+    };
+    // The same chain in each round.
+    object const data
+    {
+        {"items", array{1, 2}},
+        {"lambda", lazy_format([](...) { return "{{<mid}}{{$b}}{{.}}{{/b}}{{/mid}}"_fmt; })},
+        {"leaf", lazy_format([](...) { return "{{<leaf}}{{$c}}{{.}}{{/c}}{{/leaf}}"_fmt; })}
+    };
+    CHECK(to_string("{{#items}}{{<mid}}{{$a}}{{.}}{{/a}}{{/mid}}{{/items}}"_fmt(data).context(partials)) == "<1b1><2b1>");
+    // The chains in the temporary formats.
+    CHECK(to_string("{{#items}}{{lambda}}{{/items}}"_fmt(data).context(partials)) == "<a11><a12>");
+    CHECK(to_string("{{<mid}}{{$b}}{{#items}}{{leaf}}{{/items}}{{/b}}{{/mid}}"_fmt(data).context(partials)) == "<a1(1a1)(2a1)>");
+}
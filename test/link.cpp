@@ -0,0 +1,132 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/string.hpp>
+#include <bustache/link.hpp>
+#include "model.hpp"
+
+using namespace bustache;
+using namespace test;
+
+namespace
+{
+    // Counts the lookups.
+    struct counting_context
+    {
+        context const& partials;
+        int& lookups;
+
+        format const* operator()(std::string const& key) const
+        {
+            ++lookups;
+            return partials(key);
+        }
+    };
+
+    // The linked format renders the same, and returns the partials left.
+    std::size_t check_link(std::string const& source, context const& partials, object const& data)
+    {
+        format const fmt(source);
+        auto const expected = to_string(fmt(data).context(partials));
+        auto const linked = link(fmt, partials);
+        int lookups = 0;
+        CHECK(to_string(linked(data).context(counting_context{partials, lookups})) == expected);
+        CHECK(lookups <= int(linked.doc().ctx.partials.size()) * 4);
+        return linked.doc().ctx.partials.size();
+    }
+}
+
+TEST_CASE("link")
+{
+    context const partials
+    {
+        {"layout", "<html>\n  <body>\n    {{>content}}\n  </body>\n</html>\n"_fmt},
+        {"content", "<h1>{{title}}</h1>\n{{#items}}\n<li>{{name}}</li>\n{{/items}}\n{{^items}}\nnone\n{{/items}}\n"_fmt},
+        {"inline", "[{{title}}]"_fmt},
+        {"empty", ""_fmt}
+    };
+    object const data
+    {
+        {"title", "T"},
+        {"items", array{object{{"name", "a"}}, object{{"name", "b"}}}}
+    };
+
+    CHECK(check_link("{{>layout}}", partials, data) == 0);
+    CHECK(check_link("x {{>inline}} y\n{{>empty}}", partials, data) == 0);
+    CHECK(check_link("  {{>inline}}\n  {{>inline}}{{>inline}}\n", partials, data) == 0);
+    CHECK(check_link("{{#items}}\n  {{>inline}}\n{{/items}}", partials, data) == 0);
+    // Left as they are.
+    CHECK(check_link("{{>missing}}{{>*title}}", partials, data) == 2);
+}
+
+TEST_CASE("link_indent")
+{
+    context const partials
+    {
+        // Whether a line starts in the section depends on the round.
+        {"uneven", "{{#items}}{{name}},{{/items}}\n"_fmt},
+        // The same in each round.
+        {"even", "{{#items}}{{name}}\n{{/items}}"_fmt},
+        {"call", "a\n{{<base}}{{/base}}\n"_fmt},
+        {"base", "{{$b}}b\n{{/b}}"_fmt},
+        {"dynamic", "{{>*title}}\n"_fmt}
+    };
+    object const data
+    {
+        {"title", "even"},
+        {"items", array{object{{"name", "a"}}, object{{"name", "b"}}}}
+    };
+
+    CHECK(check_link("  {{>even}}\n", partials, data) == 0);
+    CHECK(check_link("  {{>uneven}}\n", partials, data) == 1);
+    CHECK(check_link("{{>uneven}}", partials, data) == 0);
+    CHECK(check_link("  {{>call}}\n", partials, data) == 1);
+    // Without the overriders, it's the same as `{{>base}}`.
+    CHECK(check_link("{{>call}}", partials, data) == 0);
+    CHECK(check_link("  {{>base}}\n", partials, data) == 1);
+    CHECK(check_link("  {{>dynamic}}\n", partials, data) == 1);
+}
+
+TEST_CASE("link_recursive")
+{
+    context const partials
+    {
+        {"node", "{{name}}\n{{#kids}}\n  {{>node}}\n{{/kids}}"_fmt}
+    };
+    object const data
+    {
+        {"name", "a"},
+        {"kids", array{object{{"name", "b"}, {"kids", array{object{{"name", "c"}, {"kids", array{}}}}}}}}
+    };
+    // The one inside is left as a call.
+    CHECK(check_link("{{>node}}", partials, data) == 1);
+}
+
+TEST_CASE("link_inheritance")
+{
+    context partials
+    {
+        {"base", "<{{$title}}T0{{/title}}|{{$body}}B0{{/body}}|{{$foot}}F0{{/foot}}>"_fmt},
+        {"layout", "{{<base}}{{$title}}T1{{/title}}{{$body}}[{{$main}}M1{{/main}}]{{/body}}{{/base}}"_fmt},
+        {"dynamic", "{{<base}}{{$foot}}{{>*which}}{{/foot}}{{/base}}"_fmt},
+        {"leaf", "L"_fmt}
+    };
+    object const data{{"which", "leaf"}};
+
+    CHECK(check_link("{{<layout}}{{$main}}M2{{/main}}{{$title}}T2{{/title}}{{/layout}}", partials, data) == 0);
+    CHECK(check_link("{{<layout}}{{/layout}}{{$title}}T{{/title}}", partials, data) == 0);
+    // The dynamic name can't be overridden ahead, unless it's overridden.
+    CHECK(check_link("{{>dynamic}}", partials, data) == 2);
+    CHECK(check_link("{{<dynamic}}{{$title}}T2{{/title}}{{/dynamic}}", partials, data) == 1);
+    CHECK(check_link("{{<dynamic}}{{$foot}}F2{{/foot}}{{/dynamic}}", partials, data) == 0);
+
+    // The overriders of the linked format still win.
+    format const linked = link("{{<layout}}{{$main}}M2{{/main}}{{/layout}}"_fmt, partials);
+    CHECK(to_string(linked(data).context(partials)) == "<T1|[M2]|F0>");
+    partials.emplace("linked", linked);
+    CHECK(to_string("{{<linked}}{{$title}}T3{{/title}}{{$main}}M3{{/main}}{{/linked}}"_fmt(data).context(partials)) == "<T3|[M3]|F0>");
+}
@@ -0,0 +1,140 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/string.hpp>
+#include <unordered_map>
+#include <limits>
+#include <cmath>
+#include <charconv>
+#include <cstring>
+
+using namespace bustache;
+
+namespace
+{
+    template<class T>
+    std::string render_plain(T value)
+    {
+        std::unordered_map<std::string, T> data{{"v", value}};
+        return to_string("{{v}}"_fmt(data));
+    }
+
+    // The same as `{}`, which is how they were printed before.
+    template<class T>
+    void check_plain(std::initializer_list<T> values)
+    {
+        for (T const value : values)
+        {
+            INFO("value: " << +value);
+            CHECK(render_plain(value) == detail::fmt::format("{}", value));
+        }
+    }
+
+    template<class T>
+    void check_limits()
+    {
+        using limits = std::numeric_limits<T>;
+        check_plain<T>({T(0), T(1), T(limits::max() / 3), limits::min(), limits::max()});
+    }
+}
+
+TEST_CASE("print_integer")
+{
+    check_limits<signed char>();
+    check_limits<unsigned char>();
+    check_limits<short>();
+    check_limits<unsigned short>();
+    check_limits<int>();
+    check_limits<unsigned>();
+    check_limits<long>();
+    check_limits<long long>();
+    check_limits<unsigned long long>();
+    check_plain<int>({-1, 9, 10, -10, 999999999});
+}
+
+TEST_CASE("print_floating_point")
+{
+    using limits = std::numeric_limits<double>;
+    check_plain<double>
+    ({
+        0.0, -0.0, 1.0, -1.0, 0.1, 0.3, 1.0 / 3, 2.0 / 3, 123.456, -123.456,
+        // Around the switch between the fixed and the exponent notation.
+        1e-4, 1.5e-4, 9.99e-5, 1e-5, 1e15, 1e16, 9999999999999998.0, 123456789012345.67,
+        100000.0, 1e21, 1e22, 1e100, 1.7976931348623157e308,
+        limits::min(), limits::denorm_min(), limits::epsilon(),
+        limits::infinity(), -limits::infinity(),
+        limits::quiet_NaN(), -limits::quiet_NaN()
+    });
+    check_plain<float>
+    ({
+        0.0f, -0.0f, 0.1f, 1.0f / 3, 3.14159f, 1e-4f, 1e-5f, 16777216.0f, 1e15f, 1e16f, 3.4028235e38f,
+        std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::infinity()
+    });
+}
+
+namespace
+{
+    struct Id
+    {
+        unsigned value;
+    };
+
+    // Counts the calls of `print`.
+    inline int prints = 0;
+}
+
+template<>
+struct bustache::impl_model<Id>
+{
+    static constexpr model kind = model::atom;
+};
+
+template<>
+struct bustache::impl_test<Id>
+{
+    static bool test(Id self)
+    {
+        return !!self.value;
+    }
+};
+
+template<>
+struct bustache::impl_print<Id>
+{
+    static void print(Id self, output_handler os, char const* spec)
+    {
+        ++prints;
+        char buf[max_size];
+        os(buf, print_to(self, buf) - buf);
+        if (spec)
+            os(spec, std::strlen(spec));
+    }
+
+    static constexpr std::size_t max_size = 12;
+
+    static char* print_to(Id self, char* out)
+    {
+        *out++ = '#';
+        return std::to_chars(out, out + max_size - 1, self.value).ptr;
+    }
+};
+
+static_assert(detail::PrintTo<Id>);
+
+TEST_CASE("print_to")
+{
+    std::unordered_map<std::string, Id> data{{"a", Id{42}}, {"b", Id{7}}};
+    prints = 0;
+    CHECK(to_string("{{a}},{{&b}}"_fmt(data)) == "#42,#7");
+    CHECK(prints == 0);
+    // `print` is still used with a spec.
+    CHECK(to_string("{{a:x}}"_fmt(data)) == "#42x");
+    CHECK(prints == 1);
+    // The specs not in the standard syntax are passed as is.
+    CHECK(to_string("{{a:upper}}{{b:::x}}{{=<% %>=}}<%b:{x}%>"_fmt(data)) == "#42upper#7::x#7{x}");
+    CHECK(prints == 4);
+}
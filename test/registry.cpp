@@ -0,0 +1,151 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/string.hpp>
+#include <bustache/registry.hpp>
+#include <thread>
+#include "model.hpp"
+
+using namespace bustache;
+using namespace test;
+
+namespace
+{
+    std::string render(template_snapshot const& snap, std::string_view name)
+    {
+        auto const fmt = snap.find(name);
+        return fmt ? to_string((*fmt)(object{}).context(snap)) : "";
+    }
+
+    // Both templates of version `n` render "n|n".
+    void publish(template_registry& reg, int n)
+    {
+        auto const page = std::make_shared<format const>(std::to_string(n) + "|{{>part}}", true);
+        auto const part = std::make_shared<format const>(std::to_string(n), true);
+        reg.update([&](template_snapshot::map_type& map)
+        {
+            map.insert_or_assign("page", page);
+            map.insert_or_assign("part", part);
+        });
+    }
+}
+
+TEST_CASE("registry")
+{
+    template_registry reg;
+    auto const empty = reg.snapshot();
+    CHECK(empty->version() == 0);
+    CHECK(empty->templates().empty());
+
+    reg.add("page", "<{{>part}}>"_fmt);
+    reg.add("part", "A"_fmt);
+    auto const a = reg.snapshot();
+    CHECK(a->version() == 2);
+    CHECK(render(*a, "page") == "<A>");
+
+    reg.add("part", "B"_fmt);
+    auto const b = reg.snapshot();
+    CHECK(render(*b, "page") == "<B>");
+    // The old snapshot is unchanged, and shares the page.
+    CHECK(render(*a, "page") == "<A>");
+    CHECK(a->find("page") == b->find("page"));
+
+    reg.erase("part");
+    CHECK(render(*reg.snapshot(), "page") == "<>");
+    CHECK(render(*b, "page") == "<B>");
+    CHECK(empty->templates().empty());
+}
+
+TEST_CASE("registry_pinned")
+{
+    template_registry reg;
+    reg.add("a", "1"_fmt);
+    std::weak_ptr<template_snapshot const> old;
+    {
+        auto const s1 = reg.snapshot();
+        auto const s2 = reg.snapshot();
+        CHECK(&*s1 == &*s2);
+        old = s1.share();
+        reg.add("a", "2"_fmt);
+        // Taken aside while the thread pins the old one.
+        auto const s3 = reg.snapshot();
+        CHECK(s1->version() == 1);
+        CHECK(s3->version() == 2);
+        // Still in use, so not freed by the update.
+        reg.add("b", "3"_fmt);
+        CHECK(!old.expired());
+    }
+    CHECK(reg.snapshot()->version() == 3);
+    // Freed by the first update after it's done.
+    CHECK(!old.expired());
+    reg.erase("b");
+    CHECK(old.expired());
+
+    // A shared one outlives the updates, in any thread.
+    auto const shared = reg.snapshot().share();
+    reg.erase("a");
+    reg.erase("a");
+    std::thread([&]
+    {
+        CHECK(render(*shared, "a") == "2");
+        CHECK(reg.snapshot()->templates().empty());
+    }).join();
+}
+
+TEST_CASE("registry_many")
+{
+    // The slots are freed with the registry.
+    std::weak_ptr<template_snapshot const> old;
+    for (int i = 0; i != 100; ++i)
+    {
+        template_registry reg;
+        reg.add("a", "1"_fmt);
+        old = reg.snapshot().share();
+    }
+    CHECK(old.expired());
+}
+
+TEST_CASE("registry_concurrent")
+{
+    template_registry reg;
+    publish(reg, 0);
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i != 4; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            while (!done.load())
+            {
+                // A snapshot is never torn, whatever's published meanwhile.
+                auto const snap = reg.snapshot();
+                auto const str = render(*snap, "page");
+                auto const sep = str.find('|');
+                if (sep == std::string::npos || str.substr(0, sep) != str.substr(sep + 1))
+                    ++bad;
+            }
+        });
+    }
+    std::vector<std::thread> writers;
+    for (int i = 0; i != 2; ++i)
+    {
+        writers.emplace_back([&reg, i]
+        {
+            for (int n = 1; n != 200; ++n)
+                publish(reg, n * 2 + i);
+        });
+    }
+    for (auto& t : writers)
+        t.join();
+    done = true;
+    for (auto& t : readers)
+        t.join();
+    CHECK(bad == 0);
+    // No update is lost.
+    CHECK(reg.snapshot()->version() == 1 + 2 * 199);
+}
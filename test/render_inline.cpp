@@ -0,0 +1,134 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/inline.hpp>
+#include <bustache/render/string.hpp>
+#include "model.hpp"
+
+using namespace bustache;
+using namespace test;
+
+namespace
+{
+    struct append_sink
+    {
+        std::string& out;
+
+        void operator()(char const* data, std::size_t bytes) const
+        {
+            out.append(data, bytes);
+        }
+    };
+}
+
+TEST_CASE("render_inline")
+{
+    std::unordered_map<std::string, format> partials
+    {
+        {"item", "<{{name}}>\n"_fmt},
+        {"list", "{{#items}}\n  {{>item}}\n{{/items}}"_fmt}
+    };
+    object const data
+    {
+        {"title", "a & b"},
+        {"items", array{object{{"name", "x"}}, object{{"name", "y"}}}},
+        {"n", 42}
+    };
+    format const fmt("{{title}}|{{{title}}}|{{n}}|{{missing}}\n{{>list}}");
+    std::string out;
+
+    SECTION("same as render")
+    {
+        render_inline(append_sink{out}, fmt, data, map_context(partials), escape_html);
+        CHECK(out == to_string(fmt(data).context(map_context(partials)).escape(escape_html)));
+        CHECK(out == "a &amp; b|a & b|42|\n  <x>\n  <y>\n");
+    }
+
+    SECTION("no escape")
+    {
+        render_inline(append_sink{out}, fmt, data);
+        CHECK(out == "a & b|a & b|42|\n");
+    }
+
+    SECTION("unresolved")
+    {
+        auto const unresolved = [](std::string const& key) -> value_ptr
+        {
+            static constexpr std::string_view dash("-");
+            return key == "missing" ? &dash : nullptr;
+        };
+        render_inline(append_sink{out}, fmt, data, no_context, no_escape, unresolved);
+        CHECK(out == "a & b|a & b|42|-\n");
+    }
+
+    SECTION("buffered")
+    {
+        render_inline(buffered_sink(append_sink{out}), fmt, data, map_context(partials), escape_html);
+        CHECK(out == "a &amp; b|a & b|42|\n  <x>\n  <y>\n");
+    }
+}
+
+TEST_CASE("indented_partials")
+{
+    std::unordered_map<std::string, format> partials
+    {
+        {"layout", "<div>\n  {{>body}}\n</div>\n"_fmt},
+        {"body", "a\nb {{x}}\n\nc\n"_fmt}
+    };
+    object const data{{"x", 1}};
+    format const fmt("{{>layout}}");
+    std::string out;
+    int writes = 0;
+    auto const sink = [&](char const* data, std::size_t bytes)
+    {
+        out.append(data, bytes);
+        ++writes;
+    };
+    render_inline(sink, fmt, data, map_context(partials));
+    CHECK(out == "<div>\n  a\n  b 1\n  \n  c\n</div>\n");
+    // One write per text or variable, the indent goes with the lines.
+    CHECK(writes == 5);
+}
+
+TEST_CASE("indented_partials_texts_pushed")
+{
+    // The texts pushed without `add` have no newlines recorded.
+    ast::document doc;
+    doc.ctx.texts.push_back("a\nb\n");
+    doc.contents.push_back({ast::type::text, 0});
+    doc.contents.push_back(doc.ctx.add("c\nd\n"));
+    doc.ctx.texts.push_back("e\nf");
+    doc.contents.push_back({ast::type::text, 2});
+    std::unordered_map<std::string, format> partials
+    {
+        {"body", format(std::move(doc), false)}
+    };
+    format const fmt("<\n  {{>body}}\n>");
+    std::string out;
+    render_inline(append_sink{out}, fmt, object{}, map_context(partials));
+    CHECK(out == "<\n  a\n  b\n  c\n  d\n  e\n  f>");
+}
+
+TEST_CASE("lookup_depth_cached")
+{
+    // Where a key is found depends on the parents, not on the section.
+    object const data
+    {
+        {"b", "root"},
+        {"groups", array
+        {
+            object{{"b", "x"}, {"items", array{object{}, object{}}}},
+            object{{"items", array{object{}, object{{"b", "y"}}}}},
+            object{{"items", array{object{{"c", "z"}}, object{}}}}
+        }}
+    };
+    format fmt("{{#groups}}{{#items}}{{b}}{{c}},{{/items}}|{{/groups}}");
+    CHECK(to_string(fmt(data)) == "x,x,|root,y,|rootz,root,|");
+    fmt.compile();
+    CHECK(to_string(fmt(data)) == "x,x,|root,y,|rootz,root,|");
+}
+
@@ -0,0 +1,108 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render.hpp>
+#include <algorithm>
+#include <string>
+#include "scan.hpp"
+
+using namespace bustache;
+
+namespace
+{
+    // The bytes that match nothing below, including the non-ASCII ones.
+    constexpr std::string_view filler("az09_-~\x7f\x80\xbf\xc2\xe3\xff ");
+
+    // Every length up to 64 at every offset of a 32-byte block, so that the
+    // 16/32-byte boundaries and the tails are all crossed, with a match at
+    // each position (or none at `n`) among the `fill`. The bytes around
+    // [i, e) are all matches, the kernels must not look at them.
+    template<class Scan, class Ref>
+    int compare(Scan scan, Ref ref, std::string_view fill, std::string_view matches)
+    {
+        alignas(32) char buf[160];
+        int mismatches = 0;
+        for (std::size_t offset = 0; offset != 32; ++offset)
+        {
+            for (std::size_t n = 0; n <= 64; ++n)
+            {
+                for (std::size_t pos = 0; pos <= n; ++pos)
+                {
+                    for (std::size_t k = 0; k != sizeof(buf); ++k)
+                        buf[k] = matches[k % matches.size()];
+                    auto const i = buf + offset + 32;
+                    for (std::size_t k = 0; k != n; ++k)
+                        i[k] = fill[(k + offset) % fill.size()];
+                    if (pos != n)
+                        i[pos] = matches[(pos + n) % matches.size()];
+                    auto const expected = ref(i, i + n);
+                    auto const found = scan(i, i + n);
+                    if (found != expected)
+                    {
+                        if (!mismatches++)
+                        {
+                            INFO("offset: " << offset << ", size: " << n << ", match at: " << pos);
+                            CHECK(found - i == expected - i);
+                        }
+                    }
+                }
+            }
+        }
+        return mismatches;
+    }
+}
+
+TEST_CASE("scan_kernels")
+{
+    auto const kernels = scan::available();
+    REQUIRE(kernels.size() >= 2);
+    auto const& scalar = *kernels[0];
+    CHECK(std::string_view(scalar.name) == "scalar");
+
+    detail::byte_set set;
+    for (char c : std::string_view("&<>\"\xe4\x01"))
+        set.insert(static_cast<unsigned char>(c));
+
+    for (auto const k : kernels)
+    {
+        INFO("kernels: " << k->name);
+        CHECK(compare
+        (
+            k->skip_space, scalar.skip_space,
+            " \t\n\v\f\r", "x\x80{"
+        ) == 0);
+        CHECK(compare
+        (
+            [k](char const* i, char const* e) { return k->find_byte(i, e, '{'); },
+            [&](char const* i, char const* e) { return scalar.find_byte(i, e, '{'); },
+            filler, "{"
+        ) == 0);
+        CHECK(compare
+        (
+            [k](char const* i, char const* e) { return k->find_either(i, e, '{', '\n'); },
+            [&](char const* i, char const* e) { return scalar.find_either(i, e, '{', '\n'); },
+            filler, "{\n"
+        ) == 0);
+        CHECK(compare
+        (
+            [&](char const* i, char const* e) { return k->find_in_set(i, e, set.bits); },
+            [&](char const* i, char const* e) { return scalar.find_in_set(i, e, set.bits); },
+            filler, "&<>\"\xe4\x01"
+        ) == 0);
+    }
+}
+
+TEST_CASE("scan_dispatch")
+{
+    // The wrappers go through the kernels exported from the library.
+    std::string_view const s("  x{y");
+    auto const i = s.data(), e = i + s.size();
+    CHECK(scan::skip_space(i, e) == i + 2);
+    CHECK(scan::find_byte(i, e, '{') == i + 3);
+    CHECK(scan::find_either(i, e, 'y', '{') == i + 3);
+    CHECK(std::ranges::find(scan::available(), &scan::active()) != scan::available().end());
+}
@@ -7,6 +7,8 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers.hpp>
 #include <bustache/render/string.hpp>
+#include <limits>
+#include <unordered_map>
 
 using namespace bustache;
 
@@ -83,6 +85,58 @@ TEST_CASE("fmt-spec")
     CHECK(to_string("{{s:*>10}}"_fmt(s)) == "*****hello");
 }
 
+namespace
+{
+    template<class T>
+    std::string render_spec(std::string const& spec, T value)
+    {
+        std::unordered_map<std::string, T> data{{"v", value}};
+        std::string const src = "{{v:" + spec + "}}";
+        return to_string(format(src)(data));
+    }
+
+    template<class T>
+    std::string format_spec(std::string const& spec, T value)
+    {
+        return detail::fmt::vformat("{:" + spec + "}", detail::fmt::make_format_args(value));
+    }
+
+    template<class T>
+    void check_specs(std::initializer_list<char const*> specs, std::initializer_list<T> values)
+    {
+        for (std::string const spec : specs)
+        {
+            for (T const value : values)
+            {
+                INFO("spec: " << spec << ", value: " << value);
+                CHECK(render_spec(spec, value) == format_spec(spec, value));
+            }
+        }
+    }
+}
+
+TEST_CASE("fmt-spec-parsed")
+{
+    // The same as fmt/std::format, with or without the fast path.
+    check_specs<long long>
+    (
+        {"d", "+", " d", "#x", "#X", "#b", "#B", "#o", "o", "08", "+08x", "#010b",
+         "*^9", "<6", ">6", "^7", "-^6d", "\xc2\xb7>5", "<08", "c"},
+        {0, 42, -42, std::numeric_limits<long long>::min(), std::numeric_limits<long long>::max()}
+    );
+    check_specs<unsigned>({"x", "#X", "^12b"}, {0u, 255u, ~0u});
+    check_specs<double>
+    (
+        {"e", "E", ".3f", "F", "g", ".0g", ".10G", "+.2e", "012.3f", " 010f", "*<12.1f",
+         "^12g", ".100f", "#g", "10", ".3", ".0", ".17", "+", " 12", ">12", "*^14.2",
+         "012", "-<9", "L"},
+        {0.0, -0.0, 3.1415, 1e-5, 123456789.0, 1e300, -2.5,
+         std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+         std::numeric_limits<double>::quiet_NaN()}
+    );
+    check_specs<float>({"f", ".2e", "g", "10", ".3"}, {0.1f, -3.75f, 1e20f});
+}
+
 TEST_CASE("section-alias")
 {
     Sep sep{'-'};
@@ -94,4 +148,24 @@ TEST_CASE("parse-error")
     CHECK_THROWS_WITH("{{:}}"_fmt, "invalid key");
     CHECK_THROWS_WITH("{{:a}}"_fmt, "invalid key");
     CHECK_THROWS_WITH("{{a:}}"_fmt, "invalid key");
+    CHECK_THROWS_WITH("{{a:{}}"_fmt, "invalid format spec");
+    CHECK_THROWS_WITH("{{a:x}y}}"_fmt, "invalid format spec");
+    CHECK_THROWS_WITH("{{{a:{{x}}}"_fmt, "invalid format spec");
+    CHECK_NOTHROW("{{a:%H:%M}}{{a:*^+#012.3Lf}}{{a:?}}"_fmt);
+    // Not in the standard syntax, but may be valid for the value type.
+    CHECK_NOTHROW("{{a:.}}{{a:5x5}}{{a:99999999999}}{{{a:>.x}}}{{a:::x}}{{a:upper}}{{=<% %>=}}<%a:{x}%>"_fmt);
+    // Which is only checked when printed.
+    std::unordered_map<std::string, int> const data{{"a", 1}};
+    CHECK_THROWS(to_string("{{a:>>>}}"_fmt(data)));
+    CHECK_THROWS(to_string("{{a:5x5}}"_fmt(data)));
+    try
+    {
+        format("{{a}}{{b:8}x}}");
+        FAIL();
+    }
+    catch (format_error const& e)
+    {
+        CHECK(e.code() == error_badspec);
+        CHECK(e.position() == 10);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2023 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <catch2/catch_test_macros.hpp>
+#include <bustache/render/string.hpp>
+#include <bustache/template_set.hpp>
+#include "model.hpp"
+
+using namespace bustache;
+using namespace test;
+
+namespace
+{
+    // Counts the lookups, which are only for the dynamic names.
+    struct counting_context
+    {
+        template_set const& set;
+        int& lookups;
+
+        format const* operator()(std::string const& key) const
+        {
+            ++lookups;
+            return set(key);
+        }
+    };
+
+    std::vector<unsigned> to_vector(std::span<unsigned const> slots)
+    {
+        return {slots.begin(), slots.end()};
+    }
+}
+
+TEST_CASE("template_set")
+{
+    template_set set;
+    auto const page = set.add("page", "<{{>header}}|{{>body}}|{{>*which}}>"_fmt);
+    auto const header = set.find("header");
+    auto const body = set.find("body");
+    REQUIRE(header != template_set::npos);
+    REQUIRE(body != template_set::npos);
+    CHECK(set.find("nope") == template_set::npos);
+    // Referred to, but not added yet.
+    CHECK(set.get(header) == nullptr);
+    CHECK(set.size() == 3);
+
+    set.add("header", "H"_fmt);
+    auto const other = set.add("other", "O"_fmt);
+    CHECK(set.add("body", "B{{x}}{{>header}}"_fmt) == body);
+
+    CHECK(to_vector(set.partials(page)) == std::vector<unsigned>{header, body});
+    CHECK(to_vector(set.partials(body)) == std::vector<unsigned>{header});
+    CHECK(to_vector(set.dependents(header)) == std::vector<unsigned>{page, body});
+    CHECK(set.dependents(page).empty());
+
+    object const data{{"x", 1}, {"which", "other"}};
+    int lookups = 0;
+    auto const render = [&]
+    {
+        return to_string((*set.get(page))(data).context(counting_context{set, lookups}));
+    };
+    CHECK(render() == "<H|B1H|O>");
+    CHECK(lookups == 1);
+
+    SECTION("reload")
+    {
+        auto const page_version = set.version(page);
+        auto const body_version = set.version(body);
+        auto const other_version = set.version(other);
+        set.add("header", "h"_fmt);
+        CHECK(render() == "<h|B1h|O>");
+        // Only the dependents are affected.
+        CHECK(set.version(page) != page_version);
+        CHECK(set.version(body) != body_version);
+        CHECK(set.version(other) == other_version);
+
+        set.add("body", "b"_fmt);
+        CHECK(render() == "<h|b|O>");
+        CHECK(to_vector(set.dependents(header)) == std::vector<unsigned>{page});
+    }
+}
@@ -6,6 +6,8 @@
 //////////////////////////////////////////////////////////////////////////////*/
 #include <catch2/catch_test_macros.hpp>
 #include <bustache/render/string.hpp>
+#include <map>
+#include <vector>
 
 struct Inner
 {
@@ -15,6 +17,12 @@ struct Inner
 
 struct Phantom {};
 
+struct Point
+{
+    int x, y;
+    Inner inner;
+};
+
 struct Outer
 {
     Inner inner;
@@ -74,6 +82,27 @@ struct bustache::impl_object<Phantom>
     }
 };
 
+template<>
+struct bustache::impl_model<Point>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Point>
+{
+    static value_ptr find(Point const& self, std::string_view key)
+    {
+        if (key == "x")
+            return &self.x;
+        if (key == "y")
+            return &self.y;
+        if (key == "inner")
+            return &self.inner;
+        return nullptr;
+    }
+};
+
 template<>
 struct bustache::impl_model<Outer>
 {
@@ -177,6 +206,21 @@ TEST_CASE("custom_object")
         "42;Ah-ha;Alice;10;");
 }
 
+TEST_CASE("custom_object_find")
+{
+    Point const point{1, 2, {3, "three"}};
+
+    CHECK(to_string(
+        "({{x}}, {{y}}){{z}};{{#inner}}{{i32}}:{{str}}:{{x}}{{/inner}};{{inner.str}}"_fmt(point))
+        ==
+        "(1, 2);3:three:1;three");
+
+    CHECK(to_string(
+        "{{#x}}{{y}}{{/x}}{{^z}}no z{{/z}}"_fmt(point))
+        ==
+        "2no z");
+}
+
 TEST_CASE("custom_list")
 {
     Range range{1, 11};
@@ -208,4 +252,259 @@ TEST_CASE("custom_list")
         "1\n"
         "1,2\n"
         "1,2,3\n");
-}
\ No newline at end of file
+}
+namespace
+{
+    // Count the keys that are hashed at render time.
+    struct counting_hash : key_hash
+    {
+        inline static int rehashed = 0;
+
+        using key_hash::operator();
+
+        std::size_t operator()(std::string_view key) const noexcept
+        {
+            ++rehashed;
+            return key_hash::operator()(key);
+        }
+    };
+}
+
+TEST_CASE("prehashed_map")
+{
+    using map = std::unordered_map<std::string, std::string, counting_hash, std::equal_to<>>;
+    static_assert(PrehashedMap<map>);
+    static_assert(!PrehashedMap<std::unordered_map<std::string, std::string>>);
+
+    map const data{{"a", "1"}, {"b", "2"}};
+    format const fmt("{{a}}{{b}}{{#a}}{{b}}{{/a}}{{c}}");
+    counting_hash::rehashed = 0;
+    CHECK(to_string(fmt(data)) == "122");
+    CHECK(counting_hash::rehashed == 0);
+
+    SECTION("dotted")
+    {
+        using nested = std::unordered_map<std::string, map, counting_hash, std::equal_to<>>;
+        nested const outer{{"x", data}};
+        format const fmt("{{x.a}}{{#x}}{{.b}}{{/x}}{{x.c}}{{.x.b}}");
+        counting_hash::rehashed = 0;
+        CHECK(to_string(fmt(outer)) == "122");
+        CHECK(counting_hash::rehashed == 0);
+    }
+}
+
+namespace
+{
+    // Count the comparisons that need the key as `std::string`.
+    struct counting_less
+    {
+        using is_transparent = void;
+
+        inline static int copied = 0;
+
+        bool operator()(std::string const& a, std::string const& b) const
+        {
+            ++copied;
+            return a < b;
+        }
+
+        bool operator()(std::string_view a, std::string_view b) const
+        {
+            return a < b;
+        }
+    };
+}
+
+TEST_CASE("heterogeneous_map")
+{
+    std::map<std::string, std::string, counting_less> const data{{"a", "1"}, {"b", "2"}};
+    format const fmt("{{a}}{{b}}{{c}}{{#a}}{{b}}{{/a}}");
+    counting_less::copied = 0;
+    CHECK(to_string(fmt(data)) == "122");
+    CHECK(counting_less::copied == 0);
+}
+
+namespace
+{
+    struct Row
+    {
+        int a;
+    };
+
+    struct Table
+    {
+        std::vector<Row> rows;
+        int b;
+    };
+}
+
+template<>
+struct bustache::impl_model<Row>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Row>
+{
+    inline static int lookups = 0;
+
+    static int slot(std::string_view key)
+    {
+        ++lookups;
+        return key == "a" ? 0 : -1;
+    }
+
+    static value_ptr at(Row const& self, int)
+    {
+        return &self.a;
+    }
+};
+
+template<>
+struct bustache::impl_model<Table>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Table>
+{
+    static value_ptr find(Table const& self, std::string_view key)
+    {
+        if (key == "rows")
+            return &self.rows;
+        if (key == "b")
+            return &self.b;
+        return nullptr;
+    }
+};
+
+TEST_CASE("slot_cache")
+{
+    static_assert(detail::ObjectSlot<Row>);
+    static_assert(!detail::ObjectSlot<Table>);
+
+    Table table{{}, 7};
+    std::string expected;
+    for (int i = 0; i != 100; ++i)
+    {
+        table.rows.push_back({i % 10});
+        expected += std::to_string(i % 10) + "7";
+    }
+    format const fmt("{{#rows}}{{a}}{{b}}{{c}}{{/rows}}");
+    impl_object<Row>::lookups = 0;
+    CHECK(to_string(fmt(table)) == expected);
+    // Once for each key, including the miss of `c`.
+    CHECK(impl_object<Row>::lookups == 3);
+
+    SECTION("compiled")
+    {
+        format compiled("{{#rows}}{{.a}}{{/rows}}");
+        compiled.compile();
+        impl_object<Row>::lookups = 0;
+        auto const out = to_string(compiled(table));
+        CHECK(out.size() == 100);
+        CHECK(impl_object<Row>::lookups == 1);
+    }
+}
+
+namespace
+{
+    struct Leaf
+    {
+        int a;
+    };
+
+    struct Branch
+    {
+        std::vector<Leaf> leaves;
+    };
+
+    struct Trunk
+    {
+        Branch branch;
+        int b;
+    };
+}
+
+template<>
+struct bustache::impl_model<Leaf>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Leaf>
+{
+    inline static int lookups = 0;
+
+    static value_ptr find(Leaf const& self, std::string_view key)
+    {
+        ++lookups;
+        return key == "a" ? &self.a : nullptr;
+    }
+};
+
+template<>
+struct bustache::impl_model<Branch>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Branch>
+{
+    inline static int lookups = 0;
+
+    static void get(Branch const& self, std::string const& key, value_handler visit)
+    {
+        ++lookups;
+        visit(key == "leaves" ? &self.leaves : nullptr);
+    }
+};
+
+template<>
+struct bustache::impl_model<Trunk>
+{
+    static constexpr model kind = model::object;
+};
+
+template<>
+struct bustache::impl_object<Trunk>
+{
+    inline static int lookups = 0;
+
+    static value_ptr find(Trunk const& self, std::string_view key)
+    {
+        ++lookups;
+        if (key == "branch")
+            return &self.branch;
+        if (key == "b")
+            return &self.b;
+        return nullptr;
+    }
+};
+
+TEST_CASE("depth_cache")
+{
+    Trunk trunk{{}, 7};
+    std::string expected;
+    for (int i = 0; i != 100; ++i)
+    {
+        trunk.branch.leaves.push_back({i});
+        expected += std::to_string(i) + "7;";
+    }
+    format const fmt("{{#branch}}{{#leaves}}{{a}}{{b}}{{c}};{{/leaves}}{{/branch}}");
+    impl_object<Leaf>::lookups = 0;
+    impl_object<Branch>::lookups = 0;
+    impl_object<Trunk>::lookups = 0;
+    CHECK(to_string(fmt(trunk)) == expected);
+    // Each element is asked for each key.
+    CHECK(impl_object<Leaf>::lookups == 300);
+    // Once for `leaves`, and the misses of `b` and `c` from the first element.
+    CHECK(impl_object<Branch>::lookups == 3);
+    // Once for `branch`, `b` for each element, and the miss of `c` once.
+    CHECK(impl_object<Trunk>::lookups == 102);
+}
+
@@ -17,7 +17,7 @@ value_ptr throw_on_unresolved(std::string const& key)
     throw std::runtime_error("unresolved key: " + key);
 }
 
-value_ptr banana_on_unresolved(std::string const& key)
+value_ptr banana_on_unresolved(std::string const&)
 {
     static constexpr std::string_view banana("banana");
     return &banana;
@@ -64,4 +64,10 @@ TEST_CASE("nested")
         render(void_sink, fmt, object{{"a", object{}}}, no_context, no_escape, throw_on_unresolved),
         "unresolved key: b"
     );
+
+    CHECK_THROWS_WITH
+    (
+        render(void_sink, format("{{.a.b.c}}"), object{{"a", object{}}}, no_context, no_escape, throw_on_unresolved),
+        "unresolved key: b"
+    );
 }
\ No newline at end of file